@@ -33,15 +33,15 @@ namespace CPU_RAYTRACER {
 namespace CPU_RAYTRACER {
 	inline float random_float() {
 		// Returns a random real in [0,1).
-		static std::uniform_real_distribution<float> distribution(0.0, 1.0);
-		static std::mt19937 generator;
+		static thread_local std::uniform_real_distribution<float> distribution(0.0, 1.0);
+		static thread_local std::mt19937 generator;
 		return distribution(generator);
 	}
 
 	inline float random_float(float min, float max) {
 		// Returns a random real in [min,max).
 		std::uniform_real_distribution<float> distribution(min, max);
-		static std::mt19937 generator;
+		static thread_local std::mt19937 generator;
 		return distribution(generator);
 	}
 
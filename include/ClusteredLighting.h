@@ -0,0 +1,138 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <Shader.h>
+#include <GPUProfiler.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// a point light as the shaders read it (PointLightData in shaders/cluster_common.glsl)
+struct PointLightData {
+    glm::vec4 positionRange; // xyz: world space position, w: distance beyond which the light is negligible
+    glm::vec4 color;
+};
+
+// clustered forward shading of the point lights: the view frustum is split into a grid of clusters (screen tiles times
+// exponential depth slices), a compute pass lists the lights reaching every cluster, and the object shader only loops
+// over the lights of the cluster of its fragment, so the cost per fragment follows the local light density instead of
+// the number of lights in the scene
+class ClusteredLighting {
+public:
+    // the grid, must match shaders/cluster_common.glsl
+    static const int clusterCountX = 16;
+    static const int clusterCountY = 9;
+    static const int clusterCountZ = 24;
+    static const int clusterCount = clusterCountX * clusterCountY * clusterCountZ;
+    static const int maxLightsPerCluster = 128;
+    // shader storage buffer bindings
+    static const GLuint lightBinding = 6;
+    static const GLuint clusterCountBinding = 7;
+    static const GLuint clusterIndexBinding = 8;
+
+    // the attenuation of the object shader (its uniform defaults): 1 / (constant + linear d + quadratic d^2)
+    static constexpr float attenuationConstant = 1.0f;
+    static constexpr float attenuationLinear = 0.8f;
+    static constexpr float attenuationQuadratic = 0.56f;
+    // the range of a light ends where its brightest channel falls below this
+    static constexpr float lightCutoff = 1.0f / 64.0f;
+
+    ClusteredLighting() {
+        clusterShader = new ComputeShader("shaders/light_clusters.comp");
+        glGenBuffers(1, &lightBuffer);
+        glGenBuffers(1, &clusterCountBuffer);
+        glGenBuffers(1, &clusterIndexBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterCountBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, clusterCount * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterIndexBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, clusterCount * maxLightsPerCluster * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    ~ClusteredLighting() {
+        glDeleteBuffers(1, &lightBuffer);
+        glDeleteBuffers(1, &clusterCountBuffer);
+        glDeleteBuffers(1, &clusterIndexBuffer);
+        delete clusterShader;
+    }
+
+    void clear() {
+        lights.clear();
+    }
+
+    void addPointLight(const glm::vec3 & position, const glm::vec3 & color) {
+        lights.push_back({glm::vec4(position, getLightRange(color)), glm::vec4(color, 1.0f)});
+    }
+
+    int getLightCount() const { return lights.size(); }
+
+    // the distance at which the attenuated light falls below lightCutoff
+    static float getLightRange(const glm::vec3 & color) {
+        float intensity = std::max(color.r, std::max(color.g, color.b));
+        float c = attenuationConstant - intensity / lightCutoff;
+        if (c >= 0.0f) {
+            return 0.0f;
+        }
+        return (-attenuationLinear + std::sqrt(attenuationLinear * attenuationLinear - 4.0f * attenuationQuadratic * c)) / (2.0f * attenuationQuadratic);
+    }
+
+    // the grid parameters of the object shader (RenderInfo.clusterParams)
+    static glm::vec4 getClusterParams(int width, int height, float nearPlane, float farPlane) {
+        return glm::vec4((float)clusterCountX / std::max(width, 1), (float)clusterCountY / std::max(height, 1),
+                         nearPlane, clusterCountZ / std::log(farPlane / nearPlane));
+    }
+
+    // upload the lights added since clear(), bin them into the clusters of the view frustum and bind the buffers
+    // for the object shaders
+    void update(const glm::mat4 & view, const glm::mat4 & projection, int width, int height, float nearPlane, float farPlane, GPUProfiler * profiler) {
+        GPUProfileScope scope(profiler, "Light clusters");
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+        if (lights.size() > lightCapacity) {
+            lightCapacity = std::max<size_t>(64, 2 * lights.size());
+            glBufferData(GL_SHADER_STORAGE_BUFFER, lightCapacity * sizeof(PointLightData), nullptr, GL_DYNAMIC_DRAW);
+        }
+        if (!lights.empty()) {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lights.size() * sizeof(PointLightData), lights.data());
+        }
+        else if (lightCapacity == 0) {
+            // a bound buffer must not be empty
+            lightCapacity = 64;
+            glBufferData(GL_SHADER_STORAGE_BUFFER, lightCapacity * sizeof(PointLightData), nullptr, GL_DYNAMIC_DRAW);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        bind();
+
+        clusterShader->use();
+        clusterShader->setMat4("view", view);
+        clusterShader->setMat4("inverseProjection", glm::inverse(projection));
+        clusterShader->setVec2("screenSize", glm::vec2(std::max(width, 1), std::max(height, 1)));
+        clusterShader->setFloat("nearPlane", nearPlane);
+        clusterShader->setFloat("farPlane", farPlane);
+        clusterShader->setInt("lightCount", lights.size());
+        glDispatchCompute((clusterCount + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // the buffers of the object shaders, the other passes may use the same bindings in between
+    void bind() const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, lightBinding, lightBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, clusterCountBinding, clusterCountBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, clusterIndexBinding, clusterIndexBuffer);
+    }
+
+private:
+    Shader * clusterShader;
+    std::vector<PointLightData> lights; // of this frame
+    GLuint lightBuffer = 0;
+    size_t lightCapacity = 0; // in lights
+    GLuint clusterCountBuffer = 0; // lights per cluster
+    GLuint clusterIndexBuffer = 0; // maxLightsPerCluster light indices per cluster
+
+    // not copyable
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+};
+
+#endif
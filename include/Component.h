@@ -1,9 +1,12 @@
 #ifndef COMPONENT_H
 #define COMPONENT_H
 
+#include <glm/glm.hpp>
 
 // forward declaration
 class SceneObject;
+class Shader;
+class GMVPObject;
 
 class IComponent {
 public:
@@ -39,6 +42,18 @@ public:
     // render priority, higher value means it will be rendered later
     // default value is 0, 1 for skybox, 2 for transparent objects
     renderQueue renderPriority = OPAQUE; 
+    // the program the component draws with, the render queue is grouped by it to save program switches
+    virtual const Shader * getProgram() const {
+        return nullptr;
+    }
+    // the object the component draws, if it is a single GMVPObject (the render queue may draw such objects instanced)
+    virtual GMVPObject * getDrawObject() const {
+        return nullptr;
+    }
+    // world space AABB of what the component draws, false if it has none (it is never culled then)
+    virtual bool getWorldBounds(glm::vec3 &, glm::vec3 &) const {
+        return false;
+    }
 };
 
 
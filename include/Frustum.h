@@ -0,0 +1,45 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// the view frustum as 6 planes (left, right, bottom, top, near, far), their normals point inside
+// the planes are read from the rows of the view-projection matrix (Gribb and Hartmann, "Fast Extraction of Viewing
+// Frustum Planes from the World-View-Projection Matrix"), so the boxes tested against it are in world space
+class Frustum {
+public:
+    Frustum() {}
+    Frustum(const glm::mat4 & viewProjection) {
+        setViewProjection(viewProjection);
+    }
+
+    void setViewProjection(const glm::mat4 & viewProjection) {
+        glm::vec4 rowX = glm::vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 rowY = glm::vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 rowZ = glm::vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 rowW = glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        planes[0] = rowW + rowX;
+        planes[1] = rowW - rowX;
+        planes[2] = rowW + rowY;
+        planes[3] = rowW - rowY;
+        planes[4] = rowW + rowZ;
+        planes[5] = rowW - rowZ;
+    }
+
+    // conservative: false only if the box is entirely outside one of the planes
+    bool intersectsAABB(const glm::vec3 & AA, const glm::vec3 & BB) const {
+        for (const glm::vec4 & plane : planes) {
+            // the corner of the box the furthest along the plane normal
+            glm::vec3 corner = glm::vec3(plane.x >= 0.0f ? BB.x : AA.x, plane.y >= 0.0f ? BB.y : AA.y, plane.z >= 0.0f ? BB.z : AA.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    glm::vec4 planes[6]; // xyz: normal, w: distance, not normalized (only the signs are used)
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+// per-frame GPU timing of named (nestable) scopes with timestamp queries
+// a scope writes a GL_TIMESTAMP before and after its commands, so scopes can nest (GL_TIME_ELAPSED queries cannot)
+// the queries of 'latency' frames are in flight at once: a frame is read back a few frames later, once the GPU has finished it,
+// so reading the results never stalls the CPU; if the GPU falls further behind, frames are skipped instead of waited for
+class GPUProfiler {
+public:
+    struct ScopeResult {
+        std::string name;
+        int depth; // nesting level, 0 for the frame itself
+        float milliseconds;
+    };
+
+    GPUProfiler(int _latency = 3) : latency(_latency) {
+        frames.resize(latency);
+    }
+    ~GPUProfiler() {
+        for (Frame & frame : frames) {
+            if (!frame.queries.empty()) {
+                glDeleteQueries(frame.queries.size(), frame.queries.data());
+            }
+        }
+    }
+
+    // start profiling a frame: collect the finished frames, then open the 'Frame' scope
+    void beginFrame() {
+        collectResults();
+        frameIndex++;
+        Frame & frame = frames[writeIndex];
+        active = enabled && !frame.pending;
+        if (!active) {
+            return;
+        }
+        frame.scopes.clear();
+        frame.frameIndex = frameIndex;
+        beginScope("Frame");
+    }
+
+    void endFrame() {
+        if (!active) {
+            return;
+        }
+        endScope();
+        if (!openScopes.empty()) {
+            std::cout << "[GPUProfiler]: error: " << openScopes.size() << " scopes are still open at the end of the frame" << std::endl;
+            openScopes.clear();
+        }
+        frames[writeIndex].pending = true;
+        writeIndex = (writeIndex + 1) % latency;
+        active = false;
+    }
+
+    void beginScope(const std::string & name) {
+        if (!active) {
+            return;
+        }
+        Frame & frame = frames[writeIndex];
+        int scopeIndex = frame.scopes.size();
+        reserveQueries(frame, 2 * (scopeIndex + 1));
+        frame.scopes.push_back({name, (int)openScopes.size()});
+        openScopes.push_back(scopeIndex);
+        glQueryCounter(frame.queries[2 * scopeIndex], GL_TIMESTAMP);
+    }
+
+    void endScope() {
+        if (!active || openScopes.empty()) {
+            return;
+        }
+        int scopeIndex = openScopes.back();
+        openScopes.pop_back();
+        glQueryCounter(frames[writeIndex].queries[2 * scopeIndex + 1], GL_TIMESTAMP);
+    }
+
+    void setEnabled(bool enable) { enabled = enable; }
+    bool isEnabled() const { return enabled; }
+    // the scopes of the latest frame read back, in the order they were opened
+    const std::vector<ScopeResult> & getResults() const { return results; }
+    int getResultFrame() const { return resultFrame; }
+
+    // keep every frame read back until stopRecording(), for dumping
+    void startRecording() {
+        recordedFrames.clear();
+        recording = true;
+    }
+    void stopRecording() { recording = false; }
+    bool isRecording() const { return recording; }
+    int getRecordedFrameCount() const { return recordedFrames.size(); }
+
+    // one line per scope and frame: frame,scope,depth,ms
+    bool dumpCSV(const std::string & path) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            std::cout << "[GPUProfiler]: error: cannot write " << path << std::endl;
+            return false;
+        }
+        file << "frame,scope,depth,ms\n";
+        for (const RecordedFrame & frame : getDumpFrames()) {
+            for (const ScopeResult & scope : frame.scopes) {
+                file << frame.frameIndex << "," << scope.name << "," << scope.depth << "," << scope.milliseconds << "\n";
+            }
+        }
+        std::cout << "[GPUProfiler]: wrote " << path << std::endl;
+        return true;
+    }
+
+    // [{"frame": n, "scopes": [{"name": ..., "depth": ..., "ms": ...}, ...]}, ...]
+    bool dumpJSON(const std::string & path) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            std::cout << "[GPUProfiler]: error: cannot write " << path << std::endl;
+            return false;
+        }
+        std::vector<RecordedFrame> dumpFrames = getDumpFrames();
+        file << "[\n";
+        for (size_t i = 0; i < dumpFrames.size(); i++) {
+            file << "  {\"frame\": " << dumpFrames[i].frameIndex << ", \"scopes\": [";
+            for (size_t j = 0; j < dumpFrames[i].scopes.size(); j++) {
+                const ScopeResult & scope = dumpFrames[i].scopes[j];
+                file << (j == 0 ? "" : ", ") << "{\"name\": \"" << scope.name << "\", \"depth\": " << scope.depth << ", \"ms\": " << scope.milliseconds << "}";
+            }
+            file << "]}" << (i + 1 < dumpFrames.size() ? "," : "") << "\n";
+        }
+        file << "]\n";
+        std::cout << "[GPUProfiler]: wrote " << path << std::endl;
+        return true;
+    }
+
+private:
+    struct ScopeRecord {
+        std::string name;
+        int depth;
+    };
+    struct Frame {
+        std::vector<GLuint> queries; // begin/end timestamp pair of every scope, grown on demand
+        std::vector<ScopeRecord> scopes;
+        int frameIndex = 0;
+        bool pending = false; // written, not read back yet
+    };
+    struct RecordedFrame {
+        int frameIndex;
+        std::vector<ScopeResult> scopes;
+    };
+
+    int latency;
+    std::vector<Frame> frames;
+    int writeIndex = 0;
+    int frameIndex = 0;
+    bool enabled = true;
+    bool active = false; // the current frame is being profiled
+    std::vector<int> openScopes; // stack of the open scope indices
+
+    std::vector<ScopeResult> results;
+    int resultFrame = -1;
+    bool recording = false;
+    std::vector<RecordedFrame> recordedFrames;
+    const size_t maxRecordedFrames = 100000;
+
+    void reserveQueries(Frame & frame, int count) {
+        if ((int)frame.queries.size() >= count) {
+            return;
+        }
+        int oldCount = frame.queries.size();
+        frame.queries.resize(count);
+        glGenQueries(count - oldCount, frame.queries.data() + oldCount);
+    }
+
+    // read back the finished frames, oldest first; stop at the first one the GPU is still working on
+    void collectResults() {
+        for (int i = 0; i < latency; i++) {
+            Frame & frame = frames[(writeIndex + i) % latency];
+            if (!frame.pending) {
+                continue;
+            }
+            // the end of the 'Frame' scope is the last timestamp written in the frame
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                return;
+            }
+            results.clear();
+            for (size_t s = 0; s < frame.scopes.size(); s++) {
+                GLuint64 startTime = 0, endTime = 0;
+                glGetQueryObjectui64v(frame.queries[2 * s], GL_QUERY_RESULT, &startTime);
+                glGetQueryObjectui64v(frame.queries[2 * s + 1], GL_QUERY_RESULT, &endTime);
+                results.push_back({frame.scopes[s].name, frame.scopes[s].depth, (endTime - startTime) / 1000000.0f});
+            }
+            resultFrame = frame.frameIndex;
+            frame.pending = false;
+            if (recording && recordedFrames.size() < maxRecordedFrames) {
+                recordedFrames.push_back({resultFrame, results});
+            }
+        }
+    }
+
+    // the recorded frames, or the latest frame if nothing was recorded
+    std::vector<RecordedFrame> getDumpFrames() const {
+        if (!recordedFrames.empty()) {
+            return recordedFrames;
+        }
+        if (resultFrame < 0) {
+            return {};
+        }
+        return {{resultFrame, results}};
+    }
+
+    // not copyable
+    GPUProfiler(const GPUProfiler&) = delete;
+    GPUProfiler& operator=(const GPUProfiler&) = delete;
+};
+
+// profiles the enclosing block, does nothing without a profiler
+class GPUProfileScope {
+public:
+    GPUProfileScope(GPUProfiler * _profiler, const char * name) : profiler(_profiler) {
+        if (profiler != nullptr) {
+            profiler->beginScope(name);
+        }
+    }
+    ~GPUProfileScope() {
+        if (profiler != nullptr) {
+            profiler->endScope();
+        }
+    }
+private:
+    GPUProfiler * profiler;
+    GPUProfileScope(const GPUProfileScope&) = delete;
+    GPUProfileScope& operator=(const GPUProfileScope&) = delete;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+#include <vector>
+
+// measures GPU time between begin() and end() with timestamp queries, without stalling the CPU:
+// up to 'latency' measurements can be in flight, results are collected in order once the GPU has finished them
+class GPUTimer {
+public:
+    GPUTimer(int _latency = 4) : latency(_latency) {
+        queries.resize(2 * latency);
+        glGenQueries(2 * latency, queries.data());
+    }
+    ~GPUTimer() {
+        glDeleteQueries(2 * latency, queries.data());
+    }
+
+    // return false (and measure nothing) when all queries are still in flight
+    bool begin() {
+        if (pending == latency) {
+            return false;
+        }
+        glQueryCounter(queries[2 * writeIndex], GL_TIMESTAMP);
+        started = true;
+        return true;
+    }
+
+    void end() {
+        if (!started) {
+            return;
+        }
+        glQueryCounter(queries[2 * writeIndex + 1], GL_TIMESTAMP);
+        writeIndex = (writeIndex + 1) % latency;
+        pending++;
+        started = false;
+    }
+
+    // the oldest unread measurement in milliseconds, false if the GPU has not finished it yet
+    bool getResult(float & milliseconds) {
+        if (pending == 0) {
+            return false;
+        }
+        int readIndex = (writeIndex - pending + latency) % latency;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[2 * readIndex + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return false;
+        }
+        GLuint64 startTime = 0, endTime = 0;
+        glGetQueryObjectui64v(queries[2 * readIndex], GL_QUERY_RESULT, &startTime);
+        glGetQueryObjectui64v(queries[2 * readIndex + 1], GL_QUERY_RESULT, &endTime);
+        milliseconds = (endTime - startTime) / 1000000.0f;
+        pending--;
+        return true;
+    }
+
+private:
+    int latency;
+    std::vector<GLuint> queries; // begin/end timestamp pairs
+    int writeIndex = 0;
+    int pending = 0;
+    bool started = false;
+
+    // not copyable
+    GPUTimer(const GPUTimer&) = delete;
+    GPUTimer& operator=(const GPUTimer&) = delete;
+};
+
+#endif
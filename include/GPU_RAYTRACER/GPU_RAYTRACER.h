@@ -3,6 +3,8 @@
 
 // just include all the headers here, for simplicity of including from outside
 #include "data_structures.h"
+#include "blas_builder.h"
+#include "lbvh_builder.h"
 #include "raytrace_manager.h"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,183 @@
+#ifndef GPU_RAYTRACER_BLAS_BUILDER_H
+#define GPU_RAYTRACER_BLAS_BUILDER_H
+
+#include "data_structures.h"
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cfloat>
+#include <cmath>
+
+namespace GPU_RAYTRACER{
+
+    // AABB of an encoded primitive (triangle or sphere)
+    std::pair<glm::vec3,glm::vec3> primitiveAABB(const Primitive & primitive){
+        if (primitive.primitiveInfo.x == 1){
+            // sphere: v0 is the center, v1.x the radius
+            glm::vec3 radius = glm::vec3(primitive.v1.x);
+            return std::make_pair(primitive.v0 - radius, primitive.v0 + radius);
+        }
+        return std::make_pair(glm::min(primitive.v0, glm::min(primitive.v1, primitive.v2)), glm::max(primitive.v0, glm::max(primitive.v1, primitive.v2)));
+    }
+
+    glm::vec3 primitiveCentroid(const Primitive & primitive){
+        auto bounds = primitiveAABB(primitive);
+        return 0.5f * (bounds.first + bounds.second);
+    }
+
+    // since the BLAS is relatively static in the scene, we can build it with a slower algorithm
+    // but the resulting BVH should be more efficient in the ray tracing process
+    // here we use SAH to build the BVH over primitives[left, right], the primitives are sorted in place
+    // the nodes are appended to 'nodes' in the index-array format, return the index of the subtree root
+    // a leaf only holds one primitive type, so the shader needs no per-primitive type branch: n > 0 triangles, n < 0 spheres
+    int buildBLASBVH(std::vector<Primitive> & primitives, std::vector<BLASNode> & nodes, int left, int right, int maxPrimitivesPerNode = 7) {
+        if (left > right) {
+            std::cout<<"[buildBLASBVH]: error: left > right"<<std::endl;
+            return -1;
+        }
+        BLASNode node;
+        nodes.push_back(BLASNode());
+        int idx = nodes.size()-1;
+        int sphereCount = 0;
+        for (int i = left; i <= right; i++) {
+            sphereCount += (primitives[i].primitiveInfo.x == 1) ? 1 : 0;
+        }
+        bool mixedTypes = sphereCount != 0 && sphereCount != right - left + 1;
+        if (right - left + 1 <= maxPrimitivesPerNode && !mixedTypes) {
+            // leaf node
+            node.left = -1;
+            node.right = -1;
+            node.n = (sphereCount == 0) ? (right - left + 1) : -(right - left + 1); // number of primitives in the node, negative for spheres
+            node.index = left; // point to the first primitive of the node
+            glm::vec3 AA = glm::vec3(FLT_MAX);
+            glm::vec3 BB = glm::vec3(-FLT_MAX);
+            for (int i = left; i <= right; i++) {
+                auto bounds = primitiveAABB(primitives[i]);
+                AA = glm::min(AA, bounds.first);
+                BB = glm::max(BB, bounds.second);
+            }
+            node.AA = glm::vec4(AA, 0);
+            node.BB = glm::vec4(BB, 0);
+            nodes[idx] = node;
+            return idx;
+        }
+        if (mixedTypes) {
+            // split triangles and spheres first, triangles to the left
+            std::stable_partition(primitives.begin()+left, primitives.begin()+right+1, [](const Primitive & p){
+                return p.primitiveInfo.x != 1;
+            });
+            int split = right - sphereCount;
+            int leftChild = buildBLASBVH(primitives, nodes, left, split, maxPrimitivesPerNode);
+            int rightChild = buildBLASBVH(primitives, nodes, split+1, right, maxPrimitivesPerNode);
+            node.left = leftChild;
+            node.right = rightChild;
+            node.n = 0;
+            node.index = -1;
+            node.AA = glm::min(nodes[leftChild].AA, nodes[rightChild].AA);
+            node.BB = glm::max(nodes[leftChild].BB, nodes[rightChild].BB);
+            nodes[idx] = node;
+            return idx;
+        }
+        // we now need to find the best split
+        int bestAxis = 0;
+        float bestCost = INFINITY;
+        int bestSplit = (left+right)/2;
+        for (int axis = 0; axis < 3; axis++) {
+            // sort the primitives along the axis
+            std::sort(primitives.begin()+left, primitives.begin()+right+1, [axis](const Primitive & a, const Primitive & b){
+                return primitiveCentroid(a)[axis] < primitiveCentroid(b)[axis];
+            });
+
+            // leftAAs[i] is the AA(min of xyz) of the primitives from left to i
+            std::vector<glm::vec3> leftAAs(right-left+1, glm::vec3(INFINITY));
+            std::vector<glm::vec3> leftBBs(right-left+1, glm::vec3(-INFINITY));
+            for (int i = left; i <= right; i++) {
+                auto bounds = primitiveAABB(primitives[i]);
+                int bias = (i == left) ? 0 : 1;
+                leftAAs[i-left] = glm::min(leftAAs[i-left-bias], bounds.first);
+                leftBBs[i-left] = glm::max(leftBBs[i-left-bias], bounds.second);
+            }
+
+            // rightAAs[i] is the AA(min of xyz) of the primitives from i to right
+            std::vector<glm::vec3> rightAAs(right-left+1, glm::vec3(INFINITY));
+            std::vector<glm::vec3> rightBBs(right-left+1, glm::vec3(-INFINITY));
+            for (int i = right; i >= left; i--) {
+                auto bounds = primitiveAABB(primitives[i]);
+                int bias = (i == right) ? 0 : 1;
+                rightAAs[i-left] = glm::min(rightAAs[i-left+bias], bounds.first);
+                rightBBs[i-left] = glm::max(rightBBs[i-left+bias], bounds.second);
+            }
+
+            // calculate the cost of each split
+            float cost = INFINITY;
+            int split = left;
+            for (int i = left; i < right; i++) {
+                float leftCost = AABBSurfaceArea(leftAAs[i-left], leftBBs[i-left]) * (i - left + 1);
+                float rightCost = AABBSurfaceArea(rightAAs[i-left+1], rightBBs[i-left+1]) * (right - i);
+                float splitCost = leftCost + rightCost;
+                if (splitCost < cost) {
+                    cost = splitCost;
+                    split = i;
+                }
+            }
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+        // sort the primitives along the best axis
+        std::sort(primitives.begin()+left, primitives.begin()+right+1, [bestAxis](const Primitive & a, const Primitive & b){
+            return primitiveCentroid(a)[bestAxis] < primitiveCentroid(b)[bestAxis];
+        });
+        // recursively build the left and right child
+        int leftChild = buildBLASBVH(primitives, nodes, left, bestSplit, maxPrimitivesPerNode);
+        int rightChild = buildBLASBVH(primitives, nodes, bestSplit+1, right, maxPrimitivesPerNode);
+        node.left = leftChild;
+        node.right = rightChild;
+        node.n = 0; // not a leaf node
+        node.index = -1; // not a leaf node
+        // calculate the AABB of the node
+        glm::vec3 AA = glm::vec3(FLT_MAX);
+        glm::vec3 BB = glm::vec3(-FLT_MAX);
+        if (leftChild != -1) {
+            AA = glm::min(AA, glm::vec3(nodes[leftChild].AA));
+            BB = glm::max(BB, glm::vec3(nodes[leftChild].BB));
+        }
+        if (rightChild != -1) {
+            AA = glm::min(AA, glm::vec3(nodes[rightChild].AA));
+            BB = glm::max(BB, glm::vec3(nodes[rightChild].BB));
+        }
+        if (leftChild == -1 && rightChild == -1) {
+            std::cout<<"[buildBLASBVH]: error: both left and right child are -1"<<std::endl;
+        }
+        node.AA = glm::vec4(AA, 0);
+        node.BB = glm::vec4(BB, 0);
+        nodes[idx] = node;
+        return idx;
+    }
+
+    // transform an encoded primitive from object space to world space, used to flatten static objects into one BLAS
+    // spheres only keep their shape under uniform scaling, the radius is scaled by the cube root of the determinant
+    Primitive transformPrimitive(const Primitive & primitive, const glm::mat4 & modelMatrix){
+        Primitive result = primitive;
+        result.v0 = glm::vec3(modelMatrix * glm::vec4(primitive.v0, 1.0f));
+        if (primitive.primitiveInfo.x == 1){
+            result.v1.x = primitive.v1.x * std::cbrt(std::abs(glm::determinant(glm::mat3(modelMatrix))));
+            return result;
+        }
+        result.v1 = glm::vec3(modelMatrix * glm::vec4(primitive.v1, 1.0f));
+        result.v2 = glm::vec3(modelMatrix * glm::vec4(primitive.v2, 1.0f));
+        // zero normals mean 'use the face normal', keep them zero
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+        if (primitive.n1 != glm::vec3(0.0f)){
+            result.n1 = glm::normalize(normalMatrix * primitive.n1);
+            result.n2 = glm::normalize(normalMatrix * primitive.n2);
+            result.n3 = glm::normalize(normalMatrix * primitive.n3);
+        }
+        return result;
+    }
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define GPU_DATA_STRUCTURES_H
 
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
 namespace GPU_RAYTRACER{
 
@@ -29,55 +30,108 @@ namespace GPU_RAYTRACER{
         glm::vec3 baseColor;     // base color of the material
         float fuzzOrIOR;         // fuzziness of the metal material or index of refraction of the dielectric material
         glm::vec3 AA, BB;        // its AABB bounding box
-        float padding = -1;
+        float sphereRadius = -1; // leaf only: world space radius if the leaf is an analytic sphere centered in its AABB (no BLAS traversal), otherwise -1
         glm::mat4 modelMatrix;   // model matrix of the object
     };
 
 
 
+    // encoded material, as referenced by the primitives of merged static objects
+    struct EncodedMaterial {
+        glm::vec4 info;          // x: material type, y: fuzziness or index of refraction, z: texture ID (-1 if no texture), w: reserved
+        glm::vec4 baseColor;     // xyz: base color, w: reserved
+    };
+
     // encoded primitive data
     struct Primitive {
-        glm::vec3 primitiveInfo; // x: primitive type(0: triangle, 1: sphere), y: material index (not implemented yet), z: reserved
+        glm::vec3 primitiveInfo; // x: primitive type(0: triangle, 1: sphere), y: material index into the material buffer (-1: use the material of the TLAS leaf), z: reserved
         glm::vec3 v0, v1, v2;    // position (if sphere, v0: center, vec4(v1.xyz + v2.x): quaternion rotation, v2.y: radius)
         glm::vec3 n1, n2, n3;    // normal (if sphere, these are not used)
         glm::vec2 t1, t2, t3;    // t.xy: texture coordinate UV (if sphere, same, not used)
     };
 
+    // GPU layout of the primitives, split by access frequency
+    // hot: read for every candidate intersection during traversal
+    //      triangle: (v0, material index), (e1 = v1 - v0, 0), (e2 = v2 - v0, 0)
+    //      sphere:   (center, material index), (radius, 0, 0, 0), (0, 0, 0, 0)
+    struct PackedPrimitive {
+        glm::vec4 v0;
+        glm::vec4 e1;
+        glm::vec4 e2;
+    };
+    // cold: read once for the closest hit of a triangle
+    //      vertex indices into the packed vertex buffer, w: 1 if the face normal is used (no vertex normals)
+    typedef glm::uvec4 PackedPrimitiveIndices;
+    //      x: octahedral normal as snorm16x2, y: uv as half2
+    typedef glm::uvec2 PackedVertex;
+
     const GLuint PrimitiveSize = sizeof(Primitive); // should be 12 * 9 = 108 bytes
     const GLuint TLASNodeSize = sizeof(TLASNode); // should be 128
     const GLuint BLASNodeSize = sizeof(BLASNode); // should be 48
+    const GLuint EncodedMaterialSize = sizeof(EncodedMaterial); // should be 32
+    const GLuint PackedPrimitiveSize = sizeof(PackedPrimitive); // should be 48
+    const GLuint PackedPrimitiveIndicesSize = sizeof(PackedPrimitiveIndices); // should be 16
+    const GLuint PackedVertexSize = sizeof(PackedVertex); // should be 8
 
     const GLuint PrimitiveStride = PrimitiveSize / 12; // 12 is the size of a vec3 RGB32F, the stride of the primitive data in the buffer when using TBO to sample the data
     const GLuint TLASNodeStride = TLASNodeSize / 16; // TLAS TBO we use RGBA32F
     const GLuint BLASNodeStride = BLASNodeSize / 16; // BLAS TBO we use RGBA32F
+    const GLuint EncodedMaterialStride = EncodedMaterialSize / 16; // material TBO we use RGBA32F
 
 
 
     // some helper functions
 
+    // octahedral normal encoding (Cigolle et al. 2014, "A Survey of Efficient Representations for Independent Unit Vectors")
+    GLuint packOctahedralNormal(glm::vec3 n) {
+        n /= (glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z));
+        glm::vec2 e = glm::vec2(n.x, n.y);
+        if (n.z < 0.0f) {
+            glm::vec2 signs = glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+            e = (glm::vec2(1.0f) - glm::abs(glm::vec2(e.y, e.x))) * signs;
+        }
+        return glm::packSnorm2x16(e);
+    }
 
-    std::pair<glm::vec3,glm::vec3> transformAABB2WorldSpace(const glm::vec3& AA,const glm::vec3& BB, const glm::mat4& modelMatrix) {
-        std::vector<glm::vec3> vertices = {
-            glm::vec3(AA.x, AA.y, AA.z),
-            glm::vec3(BB.x, AA.y, AA.z),
-            glm::vec3(AA.x, BB.y, AA.z),
-            glm::vec3(BB.x, BB.y, AA.z),
-            glm::vec3(AA.x, AA.y, BB.z),
-            glm::vec3(BB.x, AA.y, BB.z),
-            glm::vec3(AA.x, BB.y, BB.z),
-            glm::vec3(BB.x, BB.y, BB.z)
-        };
-        glm::vec3 new_AA = glm::vec3(modelMatrix * glm::vec4(vertices[0], 1.0f));
-        glm::vec3 new_BB = new_AA;
-
-        for (const auto& vertex : vertices) {
-            glm::vec3 transformed_vertex = glm::vec3(modelMatrix * glm::vec4(vertex, 1.0f));
-            new_AA = glm::min(new_AA, transformed_vertex);
-            new_BB = glm::max(new_BB, transformed_vertex);
+    // pack a primitive into its hot part, the vertex attributes are packed separately
+    PackedPrimitive packPrimitive(const Primitive & primitive) {
+        PackedPrimitive packed;
+        float materialIndex = primitive.primitiveInfo.y;
+        packed.v0 = glm::vec4(primitive.v0, materialIndex);
+        if (primitive.primitiveInfo.x == 1) {
+            packed.e1 = glm::vec4(primitive.v1.x, 0.0f, 0.0f, 0.0f);
+            packed.e2 = glm::vec4(0.0f);
+        }
+        else {
+            packed.e1 = glm::vec4(primitive.v1 - primitive.v0, 0.0f);
+            packed.e2 = glm::vec4(primitive.v2 - primitive.v0, 0.0f);
         }
+        return packed;
+    }
+
+    EncodedMaterial encodeMaterial(const Material & material) {
+        EncodedMaterial encoded;
+        encoded.info = glm::vec4(material.type, material.fuzzOrIOR, material.textureID, 0.0f);
+        encoded.baseColor = glm::vec4(material.baseColor, 0.0f);
+        return encoded;
+    }
+
+
+    // transform the box by its center and half extent (Arvo, Graphics Gems 1990)
+    // same result as transforming the 8 corners, without building a corner list
+    std::pair<glm::vec3,glm::vec3> transformAABB2WorldSpace(const glm::vec3& AA,const glm::vec3& BB, const glm::mat4& modelMatrix) {
+        glm::vec3 center = 0.5f * (AA + BB);
+        glm::vec3 halfExtent = 0.5f * (BB - AA);
+        glm::mat3 absModel = glm::mat3(glm::abs(glm::vec3(modelMatrix[0])), glm::abs(glm::vec3(modelMatrix[1])), glm::abs(glm::vec3(modelMatrix[2])));
+        glm::vec3 worldCenter = glm::vec3(modelMatrix * glm::vec4(center, 1.0f));
+        glm::vec3 worldHalfExtent = absModel * halfExtent;
+        return std::make_pair(worldCenter - worldHalfExtent, worldCenter + worldHalfExtent);
+    }
 
-        return std::make_pair(new_AA,new_BB);
-        
+    // surface area of an AABB, the probability term of the SAH
+    float AABBSurfaceArea(const glm::vec3& AA, const glm::vec3& BB) {
+        glm::vec3 d = glm::max(BB - AA, glm::vec3(0.0f));
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
     }
 
 
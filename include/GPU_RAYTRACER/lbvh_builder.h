@@ -0,0 +1,204 @@
+#ifndef GPU_RAYTRACER_LBVH_BUILDER_H
+#define GPU_RAYTRACER_LBVH_BUILDER_H
+
+#include <glad/glad.h>
+#include <Shader.h>
+#include "data_structures.h"
+#include <vector>
+#include <iostream>
+
+namespace GPU_RAYTRACER{
+
+    // GPU linear BVH builder for the TLAS (Karras 2012: "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees")
+    // input: one TLAS leaf node per instance, whose AABB is still in object space (the 'instance templates')
+    // output: the complete TLAS (2n-1 nodes) written directly into the TLAS buffer, root at index 0
+    // passes: world AABB + centroid bounds -> Morton codes -> radix sort -> hierarchy emission -> bottom-up AABB refit
+    class LBVHBuilder{
+    public:
+        LBVHBuilder(){
+            boundsShader = new ComputeShader("shaders/lbvh_bounds.comp");
+            mortonShader = new ComputeShader("shaders/lbvh_morton.comp");
+            radixSortShader = new ComputeShader("shaders/lbvh_radix_sort.comp");
+            emitShader = new ComputeShader("shaders/lbvh_emit.comp");
+            refitShader = new ComputeShader("shaders/lbvh_refit.comp");
+
+            glGenBuffers(1, &instanceBuffer);
+            glGenBuffers(1, &worldAABBBuffer);
+            glGenBuffers(1, &sceneBoundsBuffer);
+            glGenBuffers(2, keyBuffers);
+            glGenBuffers(2, valueBuffers);
+            glGenBuffers(1, &histogramBuffer);
+            glGenBuffers(1, &parentBuffer);
+            glGenBuffers(1, &visitBuffer);
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneBoundsBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, 6 * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        };
+
+        ~LBVHBuilder(){
+            glDeleteBuffers(1, &instanceBuffer);
+            glDeleteBuffers(1, &worldAABBBuffer);
+            glDeleteBuffers(1, &sceneBoundsBuffer);
+            glDeleteBuffers(2, keyBuffers);
+            glDeleteBuffers(2, valueBuffers);
+            glDeleteBuffers(1, &histogramBuffer);
+            glDeleteBuffers(1, &parentBuffer);
+            glDeleteBuffers(1, &visitBuffer);
+            delete boundsShader;
+            delete mortonShader;
+            delete radixSortShader;
+            delete emitShader;
+            delete refitShader;
+        };
+
+        // build the TLAS of the given instances into TLASBuffer (re-allocated if the node count changed)
+        // return the number of TLAS nodes written
+        int build(const std::vector<TLASNode> & instances, GLuint TLASBuffer){
+            int n = instances.size();
+            if (n == 0){
+                return 0;
+            }
+            int nodeCount = 2 * n - 1;
+            int groupCount = (n + workgroupSize - 1) / workgroupSize;
+            reserve(n, groupCount);
+
+            // upload the instance templates
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, n * TLASNodeSize, instances.data());
+            // reset the centroid bounds (min to the largest key, max to the smallest one)
+            GLuint initialBounds[6] = {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0u, 0u, 0u};
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneBoundsBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(initialBounds), initialBounds);
+            // reset the visit counters of the refit pass
+            GLuint zero = 0;
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, visitBuffer);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+            // the TLAS buffer is shared with the TBO sampled by the ray tracing shader
+            if (nodeCount != TLASNodeCapacity){
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, TLASBuffer);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, nodeCount * TLASNodeSize, nullptr, GL_DYNAMIC_DRAW);
+                TLASNodeCapacity = nodeCount;
+            }
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            // pass 1: world space AABBs and centroid bounds
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, worldAABBBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sceneBoundsBuffer);
+            boundsShader->use();
+            boundsShader->setInt("instanceCount", n);
+            glDispatchCompute(groupCount, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            // pass 2: Morton codes
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, keyBuffers[0]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, valueBuffers[0]);
+            mortonShader->use();
+            mortonShader->setInt("instanceCount", n);
+            glDispatchCompute(groupCount, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            // pass 3: radix sort, ping-pong between the two key/value buffers
+            // an even number of passes leaves the sorted result in keyBuffers[0]/valueBuffers[0]
+            radixSortShader->use();
+            radixSortShader->setInt("elementCount", n);
+            radixSortShader->setInt("groupCount", groupCount);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, histogramBuffer);
+            for (int pass = 0; pass < radixPassCount; pass++){
+                int src = pass % 2;
+                int dst = 1 - src;
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, keyBuffers[src]);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, valueBuffers[src]);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, keyBuffers[dst]);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, valueBuffers[dst]);
+                radixSortShader->setInt("bitOffset", pass * radixBits);
+                // histogram
+                radixSortShader->setInt("stage", 0);
+                glDispatchCompute(groupCount, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                // scan
+                radixSortShader->setInt("stage", 1);
+                glDispatchCompute(1, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                // scatter
+                radixSortShader->setInt("stage", 2);
+                glDispatchCompute(groupCount, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            }
+
+            // pass 4: hierarchy emission, leaves get their world AABB, internal nodes their children
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, keyBuffers[0]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, valueBuffers[0]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, TLASBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, parentBuffer);
+            emitShader->use();
+            emitShader->setInt("instanceCount", n);
+            glDispatchCompute(groupCount, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            // pass 5: bottom-up AABBs of the internal nodes (a single leaf is already complete)
+            if (n > 1){
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, visitBuffer);
+                refitShader->use();
+                refitShader->setInt("instanceCount", n);
+                glDispatchCompute(groupCount, 1, 1);
+            }
+            // the TLAS is read through a TBO by the ray tracing shader, and may be read back for validation
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+            return nodeCount;
+        };
+
+    private:
+        const int workgroupSize = 256; // must match WORKGROUP_SIZE in the lbvh shaders
+        const int radixBits = 4; // must match RADIX_BITS in lbvh_radix_sort.comp
+        const int radixPassCount = 8; // 8 * 4 bits covers the 30-bit Morton codes, and keeps the pass count even
+
+        ComputeShader * boundsShader;
+        ComputeShader * mortonShader;
+        ComputeShader * radixSortShader;
+        ComputeShader * emitShader;
+        ComputeShader * refitShader;
+
+        GLuint instanceBuffer; // instance templates (TLAS leaf nodes with object space AABB)
+        GLuint worldAABBBuffer; // world space AABB per instance
+        GLuint sceneBoundsBuffer; // centroid bounds, as order-preserving uints
+        GLuint keyBuffers[2]; // Morton codes (ping-pong for the radix sort)
+        GLuint valueBuffers[2]; // instance indices (ping-pong for the radix sort)
+        GLuint histogramBuffer; // radix sort digit histograms / scatter offsets
+        GLuint parentBuffer; // parent index of every TLAS node
+        GLuint visitBuffer; // arrival counters of the refit pass
+
+        int instanceCapacity = 0;
+        int groupCapacity = 0;
+        int TLASNodeCapacity = 0;
+
+        // grow the scratch buffers, they are only re-allocated when the instance count exceeds the capacity
+        void reserve(int n, int groupCount){
+            if (n > instanceCapacity){
+                instanceCapacity = n;
+                int nodeCount = 2 * n - 1;
+                allocate(instanceBuffer, n * TLASNodeSize);
+                allocate(worldAABBBuffer, n * 2 * sizeof(glm::vec4));
+                allocate(keyBuffers[0], n * sizeof(GLuint));
+                allocate(keyBuffers[1], n * sizeof(GLuint));
+                allocate(valueBuffers[0], n * sizeof(GLuint));
+                allocate(valueBuffers[1], n * sizeof(GLuint));
+                allocate(parentBuffer, nodeCount * sizeof(GLint));
+                allocate(visitBuffer, nodeCount * sizeof(GLuint));
+            }
+            if (groupCount > groupCapacity){
+                groupCapacity = groupCount;
+                allocate(histogramBuffer, groupCount * (1 << radixBits) * sizeof(GLuint));
+            }
+        };
+
+        void allocate(GLuint buffer, size_t size){
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        };
+    };
+
+}
+
+#endif
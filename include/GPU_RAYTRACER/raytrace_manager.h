@@ -3,6 +3,14 @@
 
 #include "../RayTraceObject.h"
 #include "data_structures.h"
+#include "lbvh_builder.h"
+#include "texture_pages.h"
+#include "blas_builder.h"
+#include "wavefront_tracer.h"
+#include "svgf_denoiser.h"
+#include <GPUTimer.h>
+#include <GPUProfiler.h>
+#include <deque>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -10,32 +18,103 @@
 
 namespace GPU_RAYTRACER{
 
+    // where the TLAS gets built: on the CPU (recursive median split), on the GPU (LBVH compute passes),
+    // or chosen by the instance count (the CPU builder is faster for a handful of objects)
+    enum TLASBuildMode {
+        TLAS_BUILD_CPU = 0,
+        TLAS_BUILD_GPU_LBVH = 1,
+        TLAS_BUILD_AUTO = 2
+    };
+
+    // scene features the ray tracing shader is specialized for (see the #defines in raytrace_common.glsl)
+    // branches for missing features are compiled out, and the path length becomes a compile-time loop bound
+    struct RaytraceShaderFeatures {
+        int maxDepth = 4;
+        bool hasTriangles = true;
+        bool hasSpheres = true;
+        bool hasTextures = true;
+        bool hasSkybox = true;
+        int materialMask = 15; // bit i is set if material type i is used
+        int workgroupSize = 16; // the workgroup is workgroupSize x workgroupSize
+
+        std::vector<std::string> getDefines() const {
+            return {
+                "MAX_DEPTH " + std::to_string(maxDepth),
+                std::string("HAS_TRIANGLES ") + (hasTriangles ? "1" : "0"),
+                std::string("HAS_SPHERES ") + (hasSpheres ? "1" : "0"),
+                std::string("HAS_TEXTURES ") + (hasTextures ? "1" : "0"),
+                std::string("HAS_SKYBOX ") + (hasSkybox ? "true" : "false"),
+                "MATERIAL_MASK " + std::to_string(materialMask),
+                "WORKGROUP_SIZE " + std::to_string(workgroupSize)
+            };
+        }
+        // identifies the variant in the variant cache
+        std::string getKey() const {
+            std::string key;
+            for (const std::string & define : getDefines()){
+                key += define + ";";
+            }
+            return key;
+        }
+    };
+
     class RaytraceManager{
     public:
-        RaytraceManager(int _width, int _height, const Camera * _camera, GRect * _screenCanvas) : camera(_camera), screenCanvas(_screenCanvas), width(_width), height(_height)
+        RaytraceManager(int _width, int _height, const Camera * _camera, GRect * _screenCanvas) : camera(_camera), screenCanvas(_screenCanvas), width(_width), height(_height), displayWidth(_width), displayHeight(_height)
         {
-            // generate the render texture
-            renderTexture = new TextureRenderTarget(GL_FLOAT, GL_RGBA32F);            
-
-
-            // upload an green image for now, we will replace it with the result of the ray tracing
-            // std::vector<glm::vec4> * greenImage = new std::vector<glm::vec4>(width * height, glm::vec4(0, 100, 0, 1));
-            // we use void * greenImage from heap to manually manage the memory:
-            void * greenImage = new glm::vec4[width * height];
-            for (int i = 0; i < width * height; i++){
-                ((glm::vec4*)greenImage)[i] = glm::vec4(0, 100, 0, 1);
-            }
-            //renderTexture->loadFromData(width, height, 4,(greenImage));
-            renderTexture->setSize(width, height, 4);
+            // generate the render texture, it holds the tonemapped result displayed on the screen canvas (at the display resolution,
+            // every other texture is at the traced resolution)
+            renderTexture = new TextureRenderTarget(GL_UNSIGNED_BYTE, GL_RGBA8);
+            renderTexture->setSize(displayWidth, displayHeight, 4);
             renderTexture->createGPUTexture();
-            renderTexture->updateGPUTexture(greenImage);
-
-            // generate the texture buffer for the primitives
+            // generate the accumulation texture: rgb is the sum of the samples, a the number of samples
+            accumulationTexture = new TextureRenderTarget(GL_FLOAT, GL_RGBA32F);
+            accumulationTexture->setSize(width, height, 4);
+            accumulationTexture->createGPUTexture();
+            // luminance moments of the accumulated samples (x: sum, y: sum of squares), the variance estimate of the denoiser
+            momentsTexture = new TextureRenderTarget(GL_FLOAT, GL_RGBA32F);
+            momentsTexture->setSize(width, height, 4);
+            momentsTexture->createGPUTexture();
+            // temporal reprojection: the accumulation of the previous frame, and the G-buffers (primary hits) of this frame and the previous one
+            historyTexture = new TextureRenderTarget(GL_FLOAT, GL_RGBA32F);
+            historyTexture->setSize(width, height, 4);
+            historyTexture->createGPUTexture();
+            historyMomentsTexture = new TextureRenderTarget(GL_FLOAT, GL_RGBA32F);
+            historyMomentsTexture->setSize(width, height, 4);
+            historyMomentsTexture->createGPUTexture();
+            for (int i = 0; i < 2; i++){
+                positionTextures[i] = new TextureRenderTarget(GL_FLOAT, GL_RGBA32F);
+                positionTextures[i]->setSize(width, height, 4);
+                positionTextures[i]->createGPUTexture();
+                normalTextures[i] = new TextureRenderTarget(GL_FLOAT, GL_RGBA16F);
+                normalTextures[i]->setSize(width, height, 4);
+                normalTextures[i]->createGPUTexture();
+            }
+            // surface color of the primary hits, only needed for the current frame
+            albedoTexture = new TextureRenderTarget(GL_FLOAT, GL_RGBA16F);
+            albedoTexture->setSize(width, height, 4);
+            albedoTexture->createGPUTexture();
+            // GPU time of the ray tracing dispatches, for the sample budget
+            traceTimer = new GPUTimer();
+
+            // generate the texture buffer for the primitives (hot part: positions, read during traversal)
             glGenBuffers(1, &primitiveBuffer);
             glBindBuffer(GL_TEXTURE_BUFFER, primitiveBuffer);
             glGenTextures(1, &primitiveTexture);
             glBindTexture(GL_TEXTURE_BUFFER, primitiveTexture);
-            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, primitiveBuffer);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, primitiveBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            // generate the texture buffers for the cold part of the triangles: vertex indices and packed vertex attributes
+            glGenBuffers(1, &primitiveIndexBuffer);
+            glBindBuffer(GL_TEXTURE_BUFFER, primitiveIndexBuffer);
+            glGenTextures(1, &primitiveIndexTexture);
+            glBindTexture(GL_TEXTURE_BUFFER, primitiveIndexTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, primitiveIndexBuffer);
+            glGenBuffers(1, &vertexAttributeBuffer);
+            glBindBuffer(GL_TEXTURE_BUFFER, vertexAttributeBuffer);
+            glGenTextures(1, &vertexAttributeTexture);
+            glBindTexture(GL_TEXTURE_BUFFER, vertexAttributeTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, vertexAttributeBuffer);
             glBindTexture(GL_TEXTURE_BUFFER, 0);
 
 
@@ -54,14 +133,16 @@ namespace GPU_RAYTRACER{
             glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, BLASBuffer);// vec4 would be more efficient
             glBindTexture(GL_TEXTURE_BUFFER, 0);
 
-            // generate the texture array for the scene textures
-            glGenTextures(1, &sceneTextureArray);
-            glBindTexture(GL_TEXTURE_2D_ARRAY, sceneTextureArray);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            // generate the texture buffer for the materials
+            glGenBuffers(1, &materialBuffer);
+            glBindBuffer(GL_TEXTURE_BUFFER, materialBuffer);
+            glGenTextures(1, &materialTexture);
+            glBindTexture(GL_TEXTURE_BUFFER, materialTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, materialBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+            // generate the texture pages for the scene textures
+            texturePages = new TexturePageTable();
 
 
             // compile the compute shader
@@ -69,17 +150,36 @@ namespace GPU_RAYTRACER{
 
         };
         void changeScreenSize(int _width, int _height){
-            width = _width;
-            height = _height;
+            displayWidth = _width;
+            displayHeight = _height;
             // resize the render texture
             //std::cout<<"resize render texture"<<std::endl;
-            renderTexture->resizeTexture(width, height, 4);
+            renderTexture->resizeTexture(displayWidth, displayHeight, 4);
+            // and the traced textures, at the current render scale
+            resizeTraceTargets(getScaledSize(displayWidth), getScaledSize(displayHeight));
             //glBindTexture(GL_TEXTURE_2D, renderTexture->getTextureRef());
             //glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
             //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             //glBindTexture(GL_TEXTURE_2D, 0);
         };
+        // resize every texture at the traced resolution, their content is discarded
+        void resizeTraceTargets(int _width, int _height){
+            width = _width;
+            height = _height;
+            accumulationTexture->resizeTexture(width, height, 4);
+            momentsTexture->resizeTexture(width, height, 4);
+            historyTexture->resizeTexture(width, height, 4);
+            historyMomentsTexture->resizeTexture(width, height, 4);
+            for (int i = 0; i < 2; i++){
+                positionTextures[i]->resizeTexture(width, height, 4);
+                normalTextures[i]->resizeTexture(width, height, 4);
+            }
+            albedoTexture->resizeTexture(width, height, 4);
+            // the accumulation and the previous G-buffer are gone
+            resetFrameCounter();
+            hasPreviousFrame = false;
+        };
 
         ~RaytraceManager(){
 
@@ -89,20 +189,23 @@ namespace GPU_RAYTRACER{
         void loadScene(std::vector<RayTraceObject*> _rayTraceObjects, SkyboxTexture* _skyboxTexture){
             // clear the previous data
             encodedPrimitives.clear();
-            this->rayTraceObjects = _rayTraceObjects;
+            objectPrimitiveIndex.clear();
+            objectBLASIndex.clear();
+            this->sceneObjects = _rayTraceObjects;
+            for (RayTraceObject * obj : sceneObjects){
+                // if has texture, add it to the texture pages, and set the textureID (descriptor index) of the material
+                if (obj->hasTexture()){
+                    obj->material.textureID = texturePages->addTexture(obj->getTexture());
+                }
+            }
+            // static objects are traced as one merged object, the others keep their own TLAS leaf
+            this->rayTraceObjects = mergeStaticObjects(sceneObjects);
             // put all the primitives in the scene to the encodedPrimitives list
             for (int i = 0; i < rayTraceObjects.size(); i++){
                 RayTraceObject * obj = rayTraceObjects[i];
                 int currentPrimitiveIndex = encodedPrimitives.size();
                 objectPrimitiveIndex[obj] = currentPrimitiveIndex;
                 encodedPrimitives.insert(encodedPrimitives.end(), obj->localEncodedPrimitives.begin(), obj->localEncodedPrimitives.end());
-                // if has texture, add it to the textureIDMap, and set the textureID of the material
-                if (obj->hasTexture()){
-                    // add the texture to the textureIDMap
-                    addTexture(obj->getTexture());
-                    // set the textureID of the material
-                    obj->material.textureID = textureIDMap[obj->getTexture()];
-                }
             }
 
 
@@ -113,22 +216,65 @@ namespace GPU_RAYTRACER{
             }
             // construct BVH tree
             constructBVH();
+            // the freshly built TLAS already holds the current transforms
+            for (RayTraceObject * obj : sceneObjects){
+                obj->clearTransformDirty();
+            }
             // upload the scene data to the GPU
             uploadSceneData();
             
 
         };
         // with its gpu ray tracing shader, render the scene (two passes: first pass for ray tracing, second pass for displaying the result)
-        // the first pass: it will write the result to the 'renderTexture'
+        // the first pass: it will add samplesPerDispatch samples per pixel to the 'accumulationTexture'
+        // the second pass: it will average and tonemap the accumulated samples into the 'renderTexture'
         void compute(){
+            // pick the traced resolution first, a new one restarts the accumulation
+            updateRenderScale();
             // increment the frame counter
             frameCounter++;
+            // pick the number of samples from the measured cost of the previous dispatches
+            updateSampleBudget();
+            // after a camera move, the accumulation restarts from this frame's samples and the previous one is reprojected onto it
+            bool cameraMovedThisFrame = cameraMoved;
+            cameraMoved = false;
+            bool reproject = temporalReprojection && cameraMovedThisFrame && hasPreviousFrame && frameCounter > 1;
+            // the reprojection and the denoiser both read the G-buffer of the primary hits
+            bool useGBuffer = temporalReprojection || useDenoiser;
+            bool clearAccumulation = frameCounter == 1 || reproject;
+            if (frameCounter == 1){
+                accumulatedSamples = 0;
+            }
+            else if (reproject){
+                // an upper bound, the pixels keep at most maxHistorySamples of their history
+                accumulatedSamples = std::min(accumulatedSamples, (int)maxHistorySamples);
+            }
+            accumulatedSamples += samplesPerDispatch;
+            if (raytraceComputeShader == nullptr){
+                selectRaytraceVariant();
+            }
+            // the wavefront passes are compiled on first use
+            if (useWavefront && wavefrontTracer == nullptr){
+                wavefrontTracer = new WavefrontPathTracer();
+            }
+            // so are the temporal passes and the denoiser
+            if (useGBuffer && gbufferShader == nullptr){
+                gbufferShader = new ComputeShader("shaders/raytrace_gbuffer.comp");
+                reprojectShader = new ComputeShader("shaders/raytrace_reproject.comp");
+                reprojectShader->use();
+                reprojectShader->setInt("historyTexture", 14);
+                reprojectShader->setInt("previousPositionTexture", 15);
+                reprojectShader->setInt("previousNormalTexture", 16);
+                reprojectShader->setInt("historyMomentsTexture", 17);
+            }
+            if (useDenoiser && denoiser == nullptr){
+                denoiser = new SVGFDenoiser();
+            }
             // set the uniforms for the compute shader (update the camera, frame count, screen size, etc.)
             updateUniforms();
-            // bind the compute shader
-            raytraceComputeShader->use();
-            // bind the render texture
-            glBindImageTexture(2, renderTexture->getTextureRef(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+            // bind the accumulation texture
+            glBindImageTexture(2, accumulationTexture->getTextureRef(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+            glBindImageTexture(6, momentsTexture->getTextureRef(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
             // bind the skybox texture to texture unit 1
             if (hasSkybox){
                 glActiveTexture(GL_TEXTURE1);
@@ -144,19 +290,403 @@ namespace GPU_RAYTRACER{
             glActiveTexture(GL_TEXTURE3);
             glBindTexture(GL_TEXTURE_BUFFER, BLASTexture);
 
-            // bind the scene texture array to texture unit 4
-            glActiveTexture(GL_TEXTURE4);
-            glBindTexture(GL_TEXTURE_2D_ARRAY, sceneTextureArray);
+            // bind the scene texture pages to texture unit 4 .. 9, and their descriptor table to texture unit 10
+            texturePages->bind(4, 10);
+            // bind the material texture to texture unit 11
+            glActiveTexture(GL_TEXTURE11);
+            glBindTexture(GL_TEXTURE_BUFFER, materialTexture);
+            // bind the primitive index texture and the vertex attribute texture to texture unit 12 and 13
+            glActiveTexture(GL_TEXTURE12);
+            glBindTexture(GL_TEXTURE_BUFFER, primitiveIndexTexture);
+            glActiveTexture(GL_TEXTURE13);
+            glBindTexture(GL_TEXTURE_BUFFER, vertexAttributeTexture);
             
+            // while the camera stands still (and nothing restarted the accumulation), the G-buffer of the last update still matches the view
+            if (useGBuffer && (cameraMovedThisFrame || frameCounter == 1 || !hasPreviousFrame)){
+                GPUProfileScope scope(profiler, "RT G-buffer");
+                renderGBuffer();
+            }
+            if (reproject){
+                // keep the previous accumulation, the trace below starts the accumulation over
+                glCopyImageSubData(accumulationTexture->getTextureRef(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                                   historyTexture->getTextureRef(), GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+                glCopyImageSubData(momentsTexture->getTextureRef(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                                   historyMomentsTexture->getTextureRef(), GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
+            }
+
+            {
+                GPUProfileScope scope(profiler, useWavefront ? "RT trace (wavefront)" : "RT trace (megakernel)");
+                bool timed = traceTimer->begin();
+                if (useWavefront){
+                    wavefrontTracer->trace(width, height, samplesPerDispatch, maxDepth, clearAccumulation);
+                }
+                else{
+                    // dispatch the megakernel, a thread per pixel (per pixel pair with checkerboard tracing)
+                    int groupSize = raytraceFeatures.workgroupSize;
+                    int checkerboardParity = useCheckerboard ? (frameCounter & 1) : -1;
+                    int threadsX = useCheckerboard ? (width + 1) / 2 : width;
+                    raytraceComputeShader->use();
+                    raytraceComputeShader->setBool("clearAccumulation", clearAccumulation);
+                    raytraceComputeShader->setInt("checkerboardParity", checkerboardParity);
+                    glDispatchCompute((threadsX + groupSize - 1) / groupSize, (height + groupSize - 1) / groupSize, 1);
+                }
+                if (timed){
+                    traceTimer->end();
+                    pendingSampleCounts.push_back(samplesPerDispatch);
+                }
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            }
+            if (reproject){
+                GPUProfileScope scope(profiler, "RT reprojection");
+                reprojectHistory();
+            }
+            if (useGBuffer){
+                previousViewProjection = getViewProjection();
+                hasPreviousFrame = true;
+            }
+            // the resolve reads the denoised image instead of the accumulation
+            if (useDenoiser){
+                GPUProfileScope scope(profiler, "SVGF");
+                glBindImageTexture(4, positionTextures[gbufferIndex]->getTextureRef(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+                glBindImageTexture(5, normalTextures[gbufferIndex]->getTextureRef(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+                glBindImageTexture(7, albedoTexture->getTextureRef(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+                denoiser->denoise(width, height, accumulationTexture->getTextureRef(), momentsTexture->getTextureRef(), getPixelSpreadAngle(), profiler);
+                glBindImageTexture(2, denoiser->getOutput(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+            }
+
+            // resolve the accumulated samples into the render texture, upsampled to the display resolution
+            GPUProfileScope scope(profiler, "RT resolve");
+            resolveShader->use();
+            resolveShader->setInt("imageWidth", displayWidth);
+            resolveShader->setInt("imageHeight", displayHeight);
+            resolveShader->setInt("sourceWidth", width);
+            resolveShader->setInt("sourceHeight", height);
+            resolveShader->setFloat("edgeSharpness", upscaleEdgeSharpness);
+            resolveShader->setInt("tonemapMode", tonemapMode);
+            resolveShader->setFloat("exposure", exposure);
+            glBindImageTexture(3, renderTexture->getTextureRef(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+            glDispatchCompute((displayWidth + 15) / 16, (displayHeight + 15) / 16, 1);
+            // the render texture is sampled by the screen canvas
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            // unbind the images
+            glBindImageTexture(2, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+            glBindImageTexture(3, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+            glBindImageTexture(6, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+
+        };
 
-            // dispatch the compute shader, local size is 16x16x1
+        // primary hits of this frame into the current G-buffer, the other one keeps the previous frame's
+        void renderGBuffer(){
+            gbufferIndex = 1 - gbufferIndex;
+            setSceneUniforms(gbufferShader);
+            glBindImageTexture(4, positionTextures[gbufferIndex]->getTextureRef(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+            glBindImageTexture(5, normalTextures[gbufferIndex]->getTextureRef(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+            glBindImageTexture(7, albedoTexture->getTextureRef(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+            glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+            // read as images by the reprojection now, and as textures (previous G-buffer) next frame
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        };
+
+        // add the previous accumulation, reprojected with the previous view-projection matrix, to this frame's samples
+        void reprojectHistory(){
+            int previous = 1 - gbufferIndex;
+            reprojectShader->use();
+            reprojectShader->setInt("imageWidth", width);
+            reprojectShader->setInt("imageHeight", height);
+            reprojectShader->setMat4("previousViewProjection", previousViewProjection);
+            reprojectShader->setFloat("maxHistorySamples", maxHistorySamples);
+            reprojectShader->setFloat("positionTolerance", positionTolerance);
+            reprojectShader->setFloat("normalTolerance", normalTolerance);
+            glBindImageTexture(4, positionTextures[gbufferIndex]->getTextureRef(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+            glBindImageTexture(5, normalTextures[gbufferIndex]->getTextureRef(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA16F);
+            glActiveTexture(GL_TEXTURE14);
+            glBindTexture(GL_TEXTURE_2D, historyTexture->getTextureRef());
+            glActiveTexture(GL_TEXTURE15);
+            glBindTexture(GL_TEXTURE_2D, positionTextures[previous]->getTextureRef());
+            glActiveTexture(GL_TEXTURE16);
+            glBindTexture(GL_TEXTURE_2D, normalTextures[previous]->getTextureRef());
+            glActiveTexture(GL_TEXTURE17);
+            glBindTexture(GL_TEXTURE_2D, historyMomentsTexture->getTextureRef());
+            glActiveTexture(GL_TEXTURE0);
             glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
             glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-            // unbind the render texture
-            glBindImageTexture(2, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        };
+
+        // a display extent scaled by the render scale
+        int getScaledSize(int displaySize) const {
+            return std::max(1, (int)round(displaySize * renderScale));
+        };
 
+        // angle covered by one pixel (vertical)
+        float getPixelSpreadAngle() const {
+            return atan(2.0f * tan(glm::radians(camera->Zoom) * 0.5f) / (float)height);
+        };
 
+        // the projection matching the camera rays of the path tracers (vertical fov, pixel centers, y up)
+        glm::mat4 getViewProjection() const {
+            glm::mat4 projection = glm::perspective(glm::radians(camera->Zoom), (float)width / (float)height, 0.1f, 1000.0f);
+            glm::mat4 view = glm::lookAt(camera->Position, camera->Position + camera->Front, camera->Up);
+            return projection * view;
         };
+
+        // frame time budget controller: collect the finished GPU timings, estimate the cost of one sample per pixel,
+        // and pick as many samples as fit into the budget (at most doubling per frame, so a cheap frame cannot cause a spike)
+        void updateSampleBudget(){
+            float milliseconds;
+            while (!pendingSampleCounts.empty() && traceTimer->getResult(milliseconds)){
+                int samples = pendingSampleCounts.front();
+                pendingSampleCounts.pop_front();
+                lastTraceTimeMs = milliseconds;
+                float sampleCost = milliseconds / samples;
+                msPerSample = (msPerSample <= 0.0f) ? sampleCost : (0.8f * msPerSample + 0.2f * sampleCost);
+            }
+            if (frameTimeBudgetMs <= 0.0f || msPerSample <= 0.0f){
+                return;
+            }
+            int budgetSamples = (int)(frameTimeBudgetMs / msPerSample);
+            samplesPerDispatch = glm::clamp(budgetSamples, 1, std::min(maxSamplesPerDispatch, 2 * samplesPerDispatch));
+        };
+
+        // dynamic resolution: the traced resolution is the display resolution times renderScale, picked so that one sample per pixel
+        // fits into the frame time budget (the cost of a sample grows with the pixel count); more headroom goes to samples per pixel
+        // a new resolution discards the accumulation, so the scale only changes when the accumulation restarts or the camera moves
+        void updateRenderScale(){
+            framesSinceScaleChange++;
+            if (!dynamicResolution || frameTimeBudgetMs <= 0.0f || msPerSample <= 0.0f){
+                return;
+            }
+            if (!(frameCounter == 0 || cameraMoved) || framesSinceScaleChange < minFramesBetweenScaleChanges){
+                return;
+            }
+            float targetScale = renderScale * sqrt(frameTimeBudgetMs / msPerSample);
+            targetScale = glm::clamp(round(targetScale / renderScaleStep) * renderScaleStep, minRenderScale, maxRenderScale);
+            // ignore small changes, except for reaching a bound
+            bool atBound = targetScale == minRenderScale || targetScale == maxRenderScale;
+            if (targetScale == renderScale || (std::abs(targetScale - renderScale) < 2.0f * renderScaleStep && !atBound)){
+                return;
+            }
+            // the measured cost is for the old pixel count
+            msPerSample *= (targetScale * targetScale) / (renderScale * renderScale);
+            setRenderScale(targetScale);
+        };
+        // trace at displayWidth * scale x displayHeight * scale
+        void setRenderScale(float scale){
+            renderScale = glm::clamp(scale, minRenderScale, maxRenderScale);
+            framesSinceScaleChange = 0;
+            int scaledWidth = getScaledSize(displayWidth);
+            int scaledHeight = getScaledSize(displayHeight);
+            if (scaledWidth != width || scaledHeight != height){
+                resizeTraceTargets(scaledWidth, scaledHeight);
+            }
+        };
+        float getRenderScale() const { return renderScale; }
+        // let the frame time budget pick the render scale, or keep the current one
+        void setDynamicResolution(bool enable){
+            dynamicResolution = enable;
+        };
+        bool getDynamicResolution() const { return dynamicResolution; }
+        // the range the dynamic resolution picks the render scale from
+        void setRenderScaleBounds(float minScale, float maxScale){
+            minRenderScale = glm::clamp(minScale, minRenderScaleBound, 1.0f);
+            maxRenderScale = glm::clamp(maxScale, minRenderScale, 1.0f);
+            setRenderScale(renderScale);
+        };
+        float getMinRenderScale() const { return minRenderScale; }
+        float getMaxRenderScale() const { return maxRenderScale; }
+        int getTraceWidth() const { return width; }
+        int getTraceHeight() const { return height; }
+        // trace half of the pixels per frame in a checkerboard pattern, alternating every frame (megakernel only)
+        // right after a restart of the accumulation, the missing pixels are filled from their neighbors
+        void setCheckerboard(bool enable){
+            enable = enable && !useWavefront;
+            if (enable != useCheckerboard){
+                useCheckerboard = enable;
+                // the cost per sample is halved or doubled
+                msPerSample = 0.0f;
+            }
+        };
+        bool getCheckerboard() const { return useCheckerboard; }
+        // a fixed number of samples per pixel per dispatch, disables the frame time budget controller
+        void setSamplesPerDispatch(int samples){
+            samplesPerDispatch = glm::clamp(samples, 1, maxSamplesPerDispatch);
+            frameTimeBudgetMs = 0.0f;
+        };
+        // let the controller pick the samples per dispatch so that a dispatch takes about 'milliseconds' of GPU time
+        void setFrameTimeBudget(float milliseconds){
+            frameTimeBudgetMs = milliseconds;
+        };
+        // tonemapMode 0: none (clamp), 1: ACES filmic
+        void setTonemap(int mode, float _exposure = 1.0f){
+            tonemapMode = mode;
+            exposure = _exposure;
+        };
+        // trace with the wavefront passes instead of the megakernel, both accumulate into the same image
+        // (the wavefront passes always trace every pixel, the checkerboard is turned off)
+        void setWavefront(bool enable){
+            if (enable){
+                setCheckerboard(false);
+            }
+            if (enable != useWavefront){
+                useWavefront = enable;
+                // the cost per sample of the other path tracer is unknown
+                msPerSample = 0.0f;
+                resetFrameCounter();
+            }
+        };
+        bool getWavefront() const { return useWavefront; }
+        // keep the accumulated samples through camera motion by reprojecting them, instead of restarting the accumulation
+        void setTemporalReprojection(bool enable){
+            temporalReprojection = enable;
+            hasPreviousFrame = false;
+        };
+        bool getTemporalReprojection() const { return temporalReprojection; }
+        // filter the accumulation with the SVGF passes before it is displayed, the accumulation itself is left untouched
+        void setDenoiser(bool enable){
+            useDenoiser = enable;
+            hasPreviousFrame = false;
+        };
+        bool getDenoiser() const { return useDenoiser; }
+        SVGFDenoiser * getSVGFDenoiser() { return denoiser; }
+        int getSamplesPerDispatch() const { return samplesPerDispatch; }
+        int getAccumulatedSamples() const { return accumulatedSamples; }
+        float getLastTraceTimeMs() const { return lastTraceTimeMs; }
+        // merge the static objects into one object whose primitives are in world space and carry their own material index,
+        // so that they share one BLAS and one TLAS leaf (no per-instance ray transform, shallower TLAS)
+        // return the objects to trace: the objects left alone, followed by the static batch
+        std::vector<RayTraceObject*> mergeStaticObjects(const std::vector<RayTraceObject*> & objects){
+            encodedMaterials.clear();
+            mergedStaticObjects.clear();
+            if (staticBatch != nullptr){
+                delete staticBatch;
+                staticBatch = nullptr;
+            }
+            std::vector<RayTraceObject*> tracedObjects;
+            for (RayTraceObject * obj : objects){
+                if (staticMerging && obj->getStatic() && canMergeObject(obj)){
+                    mergedStaticObjects.push_back(obj);
+                }
+                else{
+                    tracedObjects.push_back(obj);
+                }
+            }
+            if (mergedStaticObjects.size() < 2){
+                // nothing to gain from a batch of one
+                mergedStaticObjects.clear();
+                tracedObjects = objects;
+            }
+            else{
+                std::vector<Primitive> batchPrimitives;
+                for (RayTraceObject * obj : mergedStaticObjects){
+                    int materialIndex = encodedMaterials.size();
+                    encodedMaterials.push_back(encodeMaterial(obj->material));
+                    for (const Primitive & primitive : obj->localEncodedPrimitives){
+                        Primitive worldPrimitive = transformPrimitive(primitive, obj->modelMatrix);
+                        worldPrimitive.primitiveInfo.y = materialIndex;
+                        batchPrimitives.push_back(worldPrimitive);
+                    }
+                }
+                staticBatch = new RayTraceObject(batchPrimitives);
+                tracedObjects.push_back(staticBatch);
+            }
+            // keep the material buffer non-empty
+            if (encodedMaterials.empty()){
+                Material defaultMaterial = {0, 0.0f, -1, glm::vec3(1.0f)};
+                encodedMaterials.push_back(encodeMaterial(defaultMaterial));
+            }
+            return tracedObjects;
+        }
+
+        // re-merge the static batch in place after one of its objects moved: its primitives are transformed again and its
+        // BLAS rebuilt, the other objects' BLAS and the textures are left alone; the batch is the last object loadScene()
+        // laid out, so its primitives and BLAS nodes are the tail of the scene buffers and nothing else shifts
+        // return false if the batch could not be kept (a moved object can no longer be merged) and the scene was reloaded
+        bool rebuildStaticBatch(){
+            for (RayTraceObject * obj : mergedStaticObjects){
+                if (!canMergeObject(obj)){
+                    loadScene(sceneObjects, hasSkybox ? skyboxTexture : nullptr);
+                    return false;
+                }
+            }
+            GPUProfileScope scope(profiler, "Static batch rebuild");
+            std::vector<Primitive> batchPrimitives;
+            batchPrimitives.reserve(staticBatch->localEncodedPrimitives.size());
+            for (size_t i = 0; i < mergedStaticObjects.size(); i++){
+                RayTraceObject * obj = mergedStaticObjects[i];
+                for (const Primitive & primitive : obj->localEncodedPrimitives){
+                    Primitive worldPrimitive = transformPrimitive(primitive, obj->modelMatrix);
+                    worldPrimitive.primitiveInfo.y = (int)i; // the material order of mergeStaticObjects()
+                    batchPrimitives.push_back(worldPrimitive);
+                }
+            }
+            staticBatch->setEncodedPrimitives(batchPrimitives);
+
+            int primitiveIndex = objectPrimitiveIndex[staticBatch];
+            std::copy(staticBatch->localEncodedPrimitives.begin(), staticBatch->localEncodedPrimitives.end(), encodedPrimitives.begin() + primitiveIndex);
+            int BLASIndex = objectBLASIndex[staticBatch];
+            BLASNodes.resize(BLASIndex);
+            for (BLASNode node : staticBatch->localBLAS){
+                node.index += primitiveIndex;
+                if (node.left != -1){
+                    node.left += BLASIndex;
+                }
+                if (node.right != -1){
+                    node.right += BLASIndex;
+                }
+                BLASNodes.push_back(node);
+            }
+            uploadPrimitiveData(false);
+            uploadBLASData();
+            return true;
+        }
+
+        // a sphere stays a sphere in world space only under uniform scaling,
+        // and a textured sphere would lose the rotation of its uv frame, those keep their own instance
+        bool canMergeObject(RayTraceObject * obj){
+            bool hasSphere = false;
+            for (const Primitive & primitive : obj->localEncodedPrimitives){
+                if (primitive.primitiveInfo.x == 1){
+                    hasSphere = true;
+                    break;
+                }
+            }
+            if (!hasSphere){
+                return true;
+            }
+            if (obj->hasTexture()){
+                return false;
+            }
+            return hasUniformScale(obj->modelMatrix);
+        }
+
+        static bool hasUniformScale(const glm::mat4 & modelMatrix){
+            glm::vec3 scale = glm::vec3(glm::length(glm::vec3(modelMatrix[0])), glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2])));
+            return glm::abs(scale.x - scale.y) < 1e-4f * scale.x && glm::abs(scale.x - scale.z) < 1e-4f * scale.x;
+        }
+
+        // an object made of a single sphere is stored in its TLAS leaf as a world space sphere (center and radius),
+        // the ray then hits it without the inverse transform and the BLAS traversal;
+        // as for merging, only under uniform scaling and without a texture (its uv frame would lose the rotation)
+        // return the world space radius, -1 if the object keeps a BLAS instance
+        float getAnalyticSphereRadius(RayTraceObject * obj){
+            if (!analyticSpheres || obj->localEncodedPrimitives.size() != 1 || obj->localEncodedPrimitives[0].primitiveInfo.x != 1){
+                return -1.0f;
+            }
+            if (obj->hasTexture() || !hasUniformScale(obj->modelMatrix)){
+                return -1.0f;
+            }
+            return obj->localEncodedPrimitives[0].v1.x * glm::length(glm::vec3(obj->modelMatrix[0]));
+        }
+
+        // world space AABB of a TLAS leaf, tight for an analytic sphere
+        std::pair<glm::vec3,glm::vec3> getLeafWorldAABB(RayTraceObject * obj, float sphereRadius){
+            if (sphereRadius > 0.0f){
+                glm::vec3 center = glm::vec3(obj->modelMatrix * glm::vec4(obj->localEncodedPrimitives[0].v0, 1.0f));
+                return std::make_pair(center - glm::vec3(sphereRadius), center + glm::vec3(sphereRadius));
+            }
+            return transformAABB2WorldSpace(obj->AA, obj->BB, obj->modelMatrix);
+        }
+
         // construct BVH tree for the scene (in CPU, then upload to GPU)
         void constructBVH(){
             TLASNodes.clear();
@@ -180,20 +710,14 @@ namespace GPU_RAYTRACER{
             TLASNodes.push_back(TLASNode());
             int idx = TLASNodes.size() - 1;
             if (left == right){// it should be a leaf node, containing Model matrix and world space AABB, pointing to the BLAS node, which is the root of the local BLAS tree
-                node.left = -1;
-                node.right = -1;
                 RayTraceObject * obj = rayTraceObjects[left];
-                node.BLASIndex = objectBLASIndex[obj];
+                node = makeTLASLeaf(obj);
                 // this node's AABB is the world space AABB of the object (multiplied by the model matrix)
-                auto result = transformAABB2WorldSpace(obj->AA, obj->BB, obj->modelMatrix);
+                auto result = getLeafWorldAABB(obj, node.sphereRadius);
                 node.AA = result.first;
                 node.BB = result.second;
-                node.materialType = obj->material.type;
-                node.textureID = obj->material.textureID;
-                node.baseColor = obj->material.baseColor;
-                node.fuzzOrIOR = obj->material.fuzzOrIOR;
-                node.modelMatrix = obj->modelMatrix;
                 TLASNodes[idx] = node;
+                objectTLASLeafIndex[obj] = idx;
                 return idx;
             }
             // sort the objects along a random axis
@@ -234,15 +758,90 @@ namespace GPU_RAYTRACER{
         }
 
 
+        // the TLAS leaf of an object, its AABB is left in object space (the caller decides the space)
+        TLASNode makeTLASLeaf(RayTraceObject * obj){
+            TLASNode node;
+            node.left = -1;
+            node.right = -1;
+            node.BLASIndex = objectBLASIndex[obj];
+            node.AA = obj->AA;
+            node.BB = obj->BB;
+            node.materialType = obj->material.type;
+            node.textureID = obj->material.textureID;
+            node.baseColor = obj->material.baseColor;
+            node.fuzzOrIOR = obj->material.fuzzOrIOR;
+            node.modelMatrix = obj->modelMatrix;
+            // the center of an analytic sphere is the center of the leaf's AABB, in object space here as in world space
+            node.sphereRadius = getAnalyticSphereRadius(obj);
+            return node;
+        }
+
         void constructTLAS(){
+            objectTLASLeafIndex.clear();
             buildTLASBVH(0, rayTraceObjects.size() - 1);
+            // parent links for the bottom-up refit (the root has no parent)
+            TLASParents.assign(TLASNodes.size(), -1);
+            for (size_t i = 0; i < TLASNodes.size(); i++){
+                if (TLASNodes[i].BLASIndex == -1){
+                    TLASParents[(int)TLASNodes[i].left] = (int)i;
+                    TLASParents[(int)TLASNodes[i].right] = (int)i;
+                }
+            }
+            TLASAreaSum = computeTLASAreaSum();
+            builtSAHCost = getTLASSAHCost();
         };
 
+        // called every frame while the scene ticks: only the leaves of objects whose model matrix changed
+        // (and their ancestors) are refitted and uploaded, the tree is rebuilt once refitting degraded its SAH cost too much
         void updateTLAS(){
-            int oldTLASNodeCount = TLASNodes.size();
+            // the merged static geometry is in world space, moving one of its objects means re-merging the batch
+            bool staticBatchMoved = false;
+            for (RayTraceObject * obj : mergedStaticObjects){
+                if (obj->isTransformDirty()){
+                    staticBatchMoved = true;
+                    obj->clearTransformDirty();
+                }
+            }
+            if (staticBatchMoved && !rebuildStaticBatch()){
+                return;
+            }
+            std::vector<RayTraceObject*> dirtyObjects;
+            for (RayTraceObject * obj : rayTraceObjects){
+                if (obj->isTransformDirty()){
+                    dirtyObjects.push_back(obj);
+                    obj->clearTransformDirty();
+                }
+            }
+            // the batch leaf keeps its BLAS index, only its box changed
+            if (staticBatchMoved){
+                dirtyObjects.push_back(staticBatch);
+            }
+            if (dirtyObjects.empty()){
+                return;
+            }
+            GPUProfileScope scope(profiler, "TLAS update");
+            if (useGPUTLASBuilder()){
+                buildTLASOnGPU();
+                return;
+            }
+            if (TLASBuiltOnGPU || TLASNodes.size() != 2 * rayTraceObjects.size() - 1){
+                rebuildTLAS();
+                return;
+            }
+            std::vector<int> modifiedNodes = refitTLAS(dirtyObjects);
+            if (getTLASSAHCost() > builtSAHCost * SAHRebuildThreshold){
+                rebuildTLAS();
+                return;
+            }
+            updateTLASData(modifiedNodes);
+        }
+
+        // full rebuild and upload of the TLAS
+        void rebuildTLAS(){
+            size_t oldTLASNodeCount = TLASNodes.size();
             TLASNodes.clear();
             constructTLAS();
-            if (oldTLASNodeCount == TLASNodes.size()){
+            if (oldTLASNodeCount == TLASNodes.size() && !TLASBuiltOnGPU){
                 updateTLASData();
             }
             else{
@@ -250,6 +849,167 @@ namespace GPU_RAYTRACER{
             }
         }
 
+        // recompute the world AABB of the dirty objects' leaves and propagate it towards the root
+        // return the indices of the modified nodes
+        std::vector<int> refitTLAS(const std::vector<RayTraceObject*> & dirtyObjects){
+            std::vector<int> modifiedNodes;
+            for (RayTraceObject * obj : dirtyObjects){
+                auto it = objectTLASLeafIndex.find(obj);
+                if (it == objectTLASLeafIndex.end()){
+                    continue;
+                }
+                int idx = it->second;
+                TLASNode & leaf = TLASNodes[idx];
+                leaf.sphereRadius = getAnalyticSphereRadius(obj);
+                auto result = getLeafWorldAABB(obj, leaf.sphereRadius);
+                TLASAreaSum += leafCost * (AABBSurfaceArea(result.first, result.second) - AABBSurfaceArea(leaf.AA, leaf.BB));
+                leaf.AA = result.first;
+                leaf.BB = result.second;
+                leaf.modelMatrix = obj->modelMatrix;
+                modifiedNodes.push_back(idx);
+                // walk up, stop as soon as an ancestor's box does not change (its own ancestors won't either)
+                for (int parent = TLASParents[idx]; parent != -1; parent = TLASParents[parent]){
+                    TLASNode & node = TLASNodes[parent];
+                    glm::vec3 AA = glm::min(TLASNodes[(int)node.left].AA, TLASNodes[(int)node.right].AA);
+                    glm::vec3 BB = glm::max(TLASNodes[(int)node.left].BB, TLASNodes[(int)node.right].BB);
+                    if (AA == node.AA && BB == node.BB){
+                        break;
+                    }
+                    TLASAreaSum += traversalCost * (AABBSurfaceArea(AA, BB) - AABBSurfaceArea(node.AA, node.BB));
+                    node.AA = AA;
+                    node.BB = BB;
+                    modifiedNodes.push_back(parent);
+                }
+            }
+            return modifiedNodes;
+        }
+
+        // unnormalized SAH cost: sum of the node surface areas weighted by the traversal/intersection costs
+        float computeTLASAreaSum(){
+            float sum = 0.0f;
+            for (const TLASNode & node : TLASNodes){
+                sum += ((node.BLASIndex == -1) ? traversalCost : leafCost) * AABBSurfaceArea(node.AA, node.BB);
+            }
+            return sum;
+        }
+
+        // SAH cost of the TLAS relative to its root box
+        float getTLASSAHCost(){
+            if (TLASNodes.empty()){
+                return 0.0f;
+            }
+            float rootArea = AABBSurfaceArea(TLASNodes[0].AA, TLASNodes[0].BB);
+            return rootArea > 0.0f ? TLASAreaSum / rootArea : 0.0f;
+        }
+
+        void setTLASBuildMode(TLASBuildMode mode){
+            TLASBuildMode_ = mode;
+        }
+
+        // merge static objects into one world space BLAS, takes effect on the next loadScene()
+        void setStaticMerging(bool enable){
+            staticMerging = enable;
+        }
+
+        // trace single-sphere objects as analytic spheres in their TLAS leaf, takes effect on the next loadScene()
+        void setAnalyticSpheres(bool enable){
+            analyticSpheres = enable;
+        }
+
+        // store the scene textures driver-compressed, takes effect on the next uploadSceneData()
+        void setTextureCompression(bool enable){
+            texturePages->setCompression(enable);
+        }
+
+        bool useGPUTLASBuilder() const {
+            if (TLASBuildMode_ == TLAS_BUILD_AUTO){
+                return (int)rayTraceObjects.size() >= GPUTLASBuildThreshold;
+            }
+            return TLASBuildMode_ == TLAS_BUILD_GPU_LBVH;
+        }
+
+        // build the TLAS with the LBVH compute passes, the result is written straight into TLASBuffer
+        // the CPU copy (TLASNodes) is left untouched, see readbackTLASNodes()
+        void buildTLASOnGPU(){
+            if (lbvhBuilder == nullptr){
+                lbvhBuilder = new LBVHBuilder();
+            }
+            std::vector<TLASNode> instances;
+            instances.reserve(rayTraceObjects.size());
+            for (RayTraceObject * obj : rayTraceObjects){
+                instances.push_back(makeTLASLeaf(obj));
+            }
+            GPUTLASNodeCount = lbvhBuilder->build(instances, TLASBuffer);
+            TLASBuiltOnGPU = true;
+            TLASReadbackStale = true;
+            if (validateNextGPUBuild){
+                validateNextGPUBuild = false;
+                validateGPUTLAS();
+            }
+        }
+
+        // copy the GPU built TLAS back to TLASNodes (stalls the pipeline, debugging only)
+        void readbackTLASNodes(){
+            TLASNodes.resize(GPUTLASNodeCount);
+            glBindBuffer(GL_TEXTURE_BUFFER, TLASBuffer);
+            glGetBufferSubData(GL_TEXTURE_BUFFER, 0, GPUTLASNodeCount * TLASNodeSize, TLASNodes.data());
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            TLASReadbackStale = false;
+        }
+
+        // check the GPU built TLAS against the CPU builder: every instance is reached exactly once,
+        // every internal node bounds its children, and the root bounds match the CPU built root
+        bool validateGPUTLAS(){
+            readbackTLASNodes();
+            std::vector<TLASNode> GPUNodes = TLASNodes;
+            TLASNodes.clear();
+            constructTLAS();
+            std::vector<TLASNode> CPUNodes = TLASNodes;
+            TLASNodes = GPUNodes;
+
+            bool valid = GPUNodes.size() == 2 * rayTraceObjects.size() - 1;
+            const float eps = 1e-4f;
+            std::unordered_map<int, int> leafVisits;
+            std::vector<int> stack;
+            if (valid){
+                stack.push_back(0);
+            }
+            while (!stack.empty() && valid){
+                int idx = stack.back();
+                stack.pop_back();
+                if (idx < 0 || idx >= (int)GPUNodes.size()){
+                    valid = false;
+                    break;
+                }
+                const TLASNode & node = GPUNodes[idx];
+                if (node.BLASIndex != -1){
+                    leafVisits[(int)node.BLASIndex]++;
+                    continue;
+                }
+                for (int child : {(int)node.left, (int)node.right}){
+                    if (child < 0 || child >= (int)GPUNodes.size()){
+                        valid = false;
+                        break;
+                    }
+                    if (glm::any(glm::lessThan(GPUNodes[child].AA, node.AA - eps)) || glm::any(glm::greaterThan(GPUNodes[child].BB, node.BB + eps))){
+                        valid = false;
+                    }
+                    stack.push_back(child);
+                }
+            }
+            for (RayTraceObject * obj : rayTraceObjects){
+                if (leafVisits[objectBLASIndex[obj]] != 1){
+                    valid = false;
+                }
+            }
+            if (valid && !CPUNodes.empty()){
+                valid = glm::all(glm::lessThan(glm::abs(CPUNodes[0].AA - GPUNodes[0].AA), glm::vec3(eps)))
+                    && glm::all(glm::lessThan(glm::abs(CPUNodes[0].BB - GPUNodes[0].BB), glm::vec3(eps)));
+            }
+            std::cout<<"[validateGPUTLAS]: "<<GPUNodes.size()<<" nodes, "<<(valid ? "matches" : "does NOT match")<<" the CPU builder"<<std::endl;
+            return valid;
+        }
+
 
         void constructBLAS(){
             // just use the local BLAS nodes of each object to the BLASNodes list
@@ -278,6 +1038,10 @@ namespace GPU_RAYTRACER{
 
 
         void draw_TLAS_AABB(){
+            // the GPU builder does not keep a CPU copy of the nodes, it is read back once per build
+            if (TLASBuiltOnGPU && TLASReadbackStale){
+                readbackTLASNodes();
+            }
             // draw the AABB of the TLAS nodes
             for (int i = 0; i < TLASNodes.size(); i++){
                 //std::cout<<"TLAS node "<<i<<std::endl;
@@ -332,15 +1096,29 @@ namespace GPU_RAYTRACER{
 
         // upload scene data to gpu: bvh nodes, objects(geometries(triangles/spheres), materials)
         void uploadSceneData(){
+            GPUProfileScope scope(profiler, "Scene upload");
+            // the shader variant matching the features of the new scene
+            selectRaytraceVariant();
             // upload the primitives
             uploadPrimitiveData();
             // upload the bvh nodes
             // TLAS: top level acceleration structure, can be updated frequently as scene changes or meshes move
-            uploadTLASData();
+            if (useGPUTLASBuilder()){
+                buildTLASOnGPU();
+            }
+            else{
+                TLASBuiltOnGPU = false;
+                uploadTLASData();
+            }
             // BLAS: bottom level acceleration structure, should be static, can be updated rarely, e.g. when a mesh is added or removed
             uploadBLASData();
+            // upload the materials referenced by the merged static primitives
+            uploadMaterialData();
             // upload the scene textures
-            uploadSceneTextureArray();
+            {
+                GPUProfileScope textureScope(profiler, "Texture upload");
+                texturePages->upload();
+            }
 
             // upload the skybox texture
             if (hasSkybox){
@@ -353,18 +1131,76 @@ namespace GPU_RAYTRACER{
             updateUniforms();
         };
         
-        void uploadPrimitiveData(){
-            // upload the primitives
+        // pack the primitives into the GPU layout and upload them:
+        // the hot part (positions) is read for every candidate intersection, the cold part (normals and uvs) only for the closest hit
+        // vertex attributes are packed (octahedral normal + half uv) and shared between triangles when identical
+        void uploadPrimitiveData(bool printStats = true){
+            std::vector<PackedPrimitive> packedPrimitives;
+            std::vector<PackedPrimitiveIndices> packedIndices;
+            std::vector<PackedVertex> packedVertices;
+            std::unordered_map<uint64_t, GLuint> vertexIndexMap; // packed attributes -> index in packedVertices
+            packedPrimitives.reserve(encodedPrimitives.size());
+            packedIndices.reserve(encodedPrimitives.size());
+            auto addVertex = [&](const glm::vec3 & normal, const glm::vec2 & uv){
+                PackedVertex vertex = PackedVertex(packOctahedralNormal(normal), glm::packHalf2x16(uv));
+                uint64_t key = ((uint64_t)vertex.x << 32) | vertex.y;
+                auto it = vertexIndexMap.find(key);
+                if (it != vertexIndexMap.end()){
+                    return it->second;
+                }
+                GLuint index = packedVertices.size();
+                packedVertices.push_back(vertex);
+                vertexIndexMap[key] = index;
+                return index;
+            };
+            for (const Primitive & primitive : encodedPrimitives){
+                packedPrimitives.push_back(packPrimitive(primitive));
+                if (primitive.primitiveInfo.x == 1){
+                    // spheres compute their normal and uv analytically
+                    packedIndices.push_back(PackedPrimitiveIndices(0));
+                    continue;
+                }
+                // zero normals mean 'use the face normal'
+                bool useFaceNormal = primitive.n1 == glm::vec3(0.0f);
+                glm::vec3 n1 = useFaceNormal ? glm::vec3(0, 0, 1) : primitive.n1;
+                glm::vec3 n2 = useFaceNormal ? glm::vec3(0, 0, 1) : primitive.n2;
+                glm::vec3 n3 = useFaceNormal ? glm::vec3(0, 0, 1) : primitive.n3;
+                GLuint i0 = addVertex(n1, primitive.t1);
+                GLuint i1 = addVertex(n2, primitive.t2);
+                GLuint i2 = addVertex(n3, primitive.t3);
+                packedIndices.push_back(PackedPrimitiveIndices(i0, i1, i2, useFaceNormal ? 1 : 0));
+            }
+            if (packedVertices.empty()){
+                packedVertices.push_back(PackedVertex(0));
+            }
             glBindBuffer(GL_TEXTURE_BUFFER, primitiveBuffer);
-            glBufferData(GL_TEXTURE_BUFFER, encodedPrimitives.size() * PrimitiveSize, encodedPrimitives.data(), GL_STATIC_DRAW);
+            glBufferData(GL_TEXTURE_BUFFER, packedPrimitives.size() * PackedPrimitiveSize, packedPrimitives.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, primitiveIndexBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, packedIndices.size() * PackedPrimitiveIndicesSize, packedIndices.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, vertexAttributeBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, packedVertices.size() * PackedVertexSize, packedVertices.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+            if (!printStats){
+                return;
+            }
+            size_t packedBytes = packedPrimitives.size() * (PackedPrimitiveSize + PackedPrimitiveIndicesSize) + packedVertices.size() * PackedVertexSize;
+            std::cout<<"[uploadPrimitiveData]: "<<encodedPrimitives.size()<<" primitives, "<<packedVertices.size()<<" unique vertices, "
+                     <<packedBytes / 1024<<" KB (unpacked: "<<encodedPrimitives.size() * PrimitiveSize / 1024<<" KB)"<<std::endl;
         };
         // TLAS: top level acceleration structure, can be updated frequently as scene changes or meshes move
         void uploadTLASData(){
             // upload the TLAS nodes
+            TLASBuiltOnGPU = false;
             glBindBuffer(GL_TEXTURE_BUFFER, TLASBuffer);
             glBufferData(GL_TEXTURE_BUFFER, TLASNodes.size() * TLASNodeSize, TLASNodes.data(), GL_DYNAMIC_DRAW);
         };
 
+        void uploadMaterialData(){
+            glBindBuffer(GL_TEXTURE_BUFFER, materialBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, encodedMaterials.size() * EncodedMaterialSize, encodedMaterials.data(), GL_STATIC_DRAW);
+        };
+
         // BLAS: bottom level acceleration structure, should be static, can be updated rarely, e.g. when a mesh is added or removed
         void uploadBLASData(){
             // upload the BLAS nodes
@@ -374,44 +1210,87 @@ namespace GPU_RAYTRACER{
         // if the TLAS remains the same size, we can use glBufferSubData to update the TLAS data
         // otherwise, we need to call uploadTLASData() to re-allcate the buffer and re-upload the data
         void updateTLASData(){
+            TLASBuiltOnGPU = false;
             glBindBuffer(GL_TEXTURE_BUFFER, TLASBuffer);
             glBufferSubData(GL_TEXTURE_BUFFER, 0, TLASNodes.size() * TLASNodeSize, TLASNodes.data());
         };
 
+        // only upload the given nodes, merged into contiguous ranges (small gaps are uploaded too, to save calls)
+        void updateTLASData(std::vector<int> modifiedNodes){
+            if (modifiedNodes.empty()){
+                return;
+            }
+            std::sort(modifiedNodes.begin(), modifiedNodes.end());
+            glBindBuffer(GL_TEXTURE_BUFFER, TLASBuffer);
+            int rangeBegin = modifiedNodes[0];
+            int rangeEnd = rangeBegin;
+            for (size_t i = 1; i <= modifiedNodes.size(); i++){
+                if (i < modifiedNodes.size() && modifiedNodes[i] <= rangeEnd + 1 + maxTLASUploadGap){
+                    rangeEnd = std::max(rangeEnd, modifiedNodes[i]);
+                    continue;
+                }
+                glBufferSubData(GL_TEXTURE_BUFFER, rangeBegin * TLASNodeSize, (rangeEnd - rangeBegin + 1) * TLASNodeSize, &TLASNodes[rangeBegin]);
+                if (i < modifiedNodes.size()){
+                    rangeBegin = rangeEnd = modifiedNodes[i];
+                }
+            }
+        };
+
 
         void updateUniforms(){
             // set the uniforms for the compute shader
-            raytraceComputeShader->use();
-            raytraceComputeShader->setInt("primitives", 0); // primitive texture is bound to texture unit 0
-            raytraceComputeShader->setInt("skyboxTexture", 1); // skybox texture is bound to texture unit 1
-            raytraceComputeShader->setInt("TLAS", 2); // TLAS texture is bound to texture unit 2
-            raytraceComputeShader->setInt("BLAS", 3); // BLAS texture is bound to texture unit 3
-            raytraceComputeShader->setInt("sceneTextures", 4); // scene texture array is bound to texture unit 4
-            raytraceComputeShader->setVec3("cameraPos", camera->Position);
-            raytraceComputeShader->setVec3("cameraFront", camera->Front);
-            raytraceComputeShader->setVec3("cameraUp", camera->Up);
-            raytraceComputeShader->setFloat("fov", camera->Zoom);
-            raytraceComputeShader->setFloat("aspectRatio", (float)width / (float)height);
-            raytraceComputeShader->setBool("hasSkybox", hasSkybox);
-            raytraceComputeShader->setInt("imageWidth", width);
-            raytraceComputeShader->setInt("imageHeight", height);
-            raytraceComputeShader->setInt("primitiveCount", encodedPrimitives.size());
-            raytraceComputeShader->setInt("maxDepth", 4);
-            raytraceComputeShader->setInt("frameCounter", frameCounter);
-            // upload a time
-            float time = glfwGetTime();
-            raytraceComputeShader->setFloat("time", time);
+            setSceneUniforms(raytraceComputeShader);
+            raytraceComputeShader->setInt("samplesPerPixel", samplesPerDispatch);
+            // the wavefront passes read the same scene
+            if (useWavefront && wavefrontTracer != nullptr){
+                for (Shader * shader : wavefrontTracer->getScenePrograms()){
+                    setSceneUniforms(shader);
+                }
+            }
 
             //std::cout<<"primitive count: "<<encodedPrimitives.size()<<std::endl;
         };
+
+        // camera, scene and texture unit uniforms shared by every program that traces the scene
+        void setSceneUniforms(Shader * shader){
+            shader->use();
+            shader->setInt("primitives", 0); // primitive texture is bound to texture unit 0
+            shader->setInt("skyboxTexture", 1); // skybox texture is bound to texture unit 1
+            shader->setInt("TLAS", 2); // TLAS texture is bound to texture unit 2
+            shader->setInt("BLAS", 3); // BLAS texture is bound to texture unit 3
+            for (int i = 0; i < TexturePageTable::pageCount; i++){
+                shader->setInt("sceneTexturePages[" + std::to_string(i) + "]", 4 + i); // scene texture pages are bound to texture unit 4 .. 9
+            }
+            shader->setInt("textureDescriptors", 10); // texture descriptor table is bound to texture unit 10
+            shader->setInt("materials", 11); // material texture is bound to texture unit 11
+            shader->setInt("primitiveIndices", 12); // primitive index texture is bound to texture unit 12
+            shader->setInt("vertexAttributes", 13); // vertex attribute texture is bound to texture unit 13
+            shader->setVec3("cameraPos", camera->Position);
+            shader->setVec3("cameraFront", camera->Front);
+            shader->setVec3("cameraUp", camera->Up);
+            shader->setFloat("fov", camera->Zoom);
+            shader->setFloat("aspectRatio", (float)width / (float)height);
+            // spread angle of the ray cone through one pixel, used to select the texture mip level
+            shader->setFloat("pixelSpreadAngle", getPixelSpreadAngle());
+            shader->setBool("hasSkybox", hasSkybox);
+            shader->setInt("imageWidth", width);
+            shader->setInt("imageHeight", height);
+            shader->setInt("primitiveCount", encodedPrimitives.size());
+            shader->setInt("maxDepth", maxDepth);
+            shader->setInt("frameCounter", frameCounter);
+            // upload a time
+            float time = glfwGetTime();
+            shader->setFloat("time", time);
+        };
         
 
 
         // set shaders for the ray tracing pipeline: compute shader for ray tracing, vertex/fragment shaders for displaying the result
         // hard coded shaders for now, since we are not going to change them
         void setShaders(){
-            // compute shader
-            raytraceComputeShader = new ComputeShader("shaders/raytrace_compute_shader.comp");
+            // the compute shader is compiled per scene feature set, see selectRaytraceVariant()
+            // resolve (average + tonemap) shader
+            resolveShader = new ComputeShader("shaders/raytrace_resolve.comp");
             // debug AABB shader
             debugAABBShader = new Shader("shaders/debug_AABB.vert", "shaders/debug_AABB.frag");
             // set up the VAO and VBO for drawing AABBs
@@ -427,6 +1306,73 @@ namespace GPU_RAYTRACER{
 
 
 
+        };
+        // the features of the loaded scene, the maximal ones if specialization is off
+        RaytraceShaderFeatures collectSceneFeatures(){
+            RaytraceShaderFeatures features;
+            features.maxDepth = maxDepth;
+            features.workgroupSize = workgroupSize;
+            if (!shaderSpecialization){
+                return features;
+            }
+            features.hasTriangles = false;
+            features.hasSpheres = false;
+            for (const Primitive & primitive : encodedPrimitives){
+                if (primitive.primitiveInfo.x == 1){
+                    features.hasSpheres = true;
+                }
+                else{
+                    features.hasTriangles = true;
+                }
+            }
+            features.hasTextures = false;
+            features.materialMask = 0;
+            for (RayTraceObject * obj : sceneObjects){
+                features.hasTextures = features.hasTextures || obj->hasTexture();
+                if (obj->material.type >= 0 && obj->material.type < 4){
+                    features.materialMask |= 1 << obj->material.type;
+                }
+            }
+            features.hasSkybox = hasSkybox;
+            return features;
+        };
+
+        // switch to the compute shader variant specialized for the loaded scene, compiled on first use and cached
+        void selectRaytraceVariant(){
+            raytraceFeatures = collectSceneFeatures();
+            std::string key = shaderSpecialization ? raytraceFeatures.getKey() : "";
+            auto it = raytraceVariants.find(key);
+            if (it != raytraceVariants.end()){
+                raytraceComputeShader = it->second;
+                return;
+            }
+            std::vector<std::string> defines;
+            if (shaderSpecialization){
+                defines = raytraceFeatures.getDefines();
+            }
+            else{
+                // the unspecialized shader still needs the workgroup size used for the dispatch
+                defines.push_back("WORKGROUP_SIZE " + std::to_string(workgroupSize));
+            }
+            std::cout<<"[selectRaytraceVariant]: compiling variant "<<(key.empty() ? "(unspecialized)" : key)<<std::endl;
+            raytraceComputeShader = new ComputeShader("shaders/raytrace_compute_shader.comp", defines);
+            raytraceVariants[key] = raytraceComputeShader;
+        };
+
+        // compile the ray tracing shader for the features of the scene (default), or one variant for every scene
+        void setShaderSpecialization(bool enable){
+            shaderSpecialization = enable;
+            selectRaytraceVariant();
+        };
+        // edge length of the square workgroup of the megakernel
+        void setWorkgroupSize(int size){
+            workgroupSize = size;
+            selectRaytraceVariant();
+        };
+
+        // optional: GPU timings of the ray tracing passes and the scene uploads
+        void setProfiler(GPUProfiler * _profiler){
+            profiler = _profiler;
         };
         void setScreenCanvas(GRect * _screenCanvas){
             screenCanvas = _screenCanvas;
@@ -447,6 +1393,14 @@ namespace GPU_RAYTRACER{
         void resetFrameCounter(){
             frameCounter = 0;
         };
+        // the camera moved: reproject the accumulation if temporal reprojection is on, restart it otherwise
+        // (the G-buffer is rendered again in both cases)
+        void notifyCameraMoved(){
+            cameraMoved = true;
+            if (!temporalReprojection){
+                resetFrameCounter();
+            }
+        };
     private:
         TextureRenderTarget * renderTexture; // render texture object
         GLuint TLASBuffer; // top level acceleration structure buffer
@@ -455,17 +1409,51 @@ namespace GPU_RAYTRACER{
         GLuint BLASTexture; // texture buffer for the BLAS
         GLuint primitiveBuffer; // tbo for primitives (triangles/spheres)
         GLuint primitiveTexture; // texture buffer for the primitives
+        GLuint primitiveIndexBuffer; // tbo for the vertex indices of the triangles
+        GLuint primitiveIndexTexture; // texture buffer for the vertex indices of the triangles
+        GLuint vertexAttributeBuffer; // tbo for the packed vertex attributes (normal, uv)
+        GLuint vertexAttributeTexture; // texture buffer for the packed vertex attributes
         bool hasSkybox = false;
         SkyboxTexture * skyboxTexture; // skybox texture
 
-        std::vector<RayTraceObject*> rayTraceObjects; // objects in the scene
+        std::vector<RayTraceObject*> sceneObjects; // objects in the scene, as given to loadScene()
+        std::vector<RayTraceObject*> rayTraceObjects; // objects with their own TLAS leaf: the dynamic objects and the static batch
         std::unordered_map<RayTraceObject*, int> objectPrimitiveIndex; // map from object ptr to its Primitive starting index(shift amount in the primitive buffer)
         std::unordered_map<RayTraceObject*, int> objectBLASIndex; // map from object ptr to its BLAS starting index(shift amount in the BLAS buffer)
         std::vector<Primitive> encodedPrimitives; // triangles and spheres
         std::vector<TLASNode> TLASNodes;
         std::vector<BLASNode> BLASNodes;
+        // static object merging
+        bool staticMerging = true;
+        RayTraceObject * staticBatch = nullptr; // world space primitives of all merged static objects
+        std::vector<RayTraceObject*> mergedStaticObjects; // the objects inside the static batch
+        std::vector<EncodedMaterial> encodedMaterials; // materials referenced by the primitives of the static batch
+        bool analyticSpheres = true; // single-sphere objects are intersected in their TLAS leaf
+        GLuint materialBuffer; // tbo for the materials
+        GLuint materialTexture; // texture buffer for the materials
+        // incremental TLAS refit
+        std::unordered_map<RayTraceObject*, int> objectTLASLeafIndex; // map from object ptr to its TLAS leaf node index
+        std::vector<int> TLASParents; // parent index of every TLAS node, -1 for the root
+        float TLASAreaSum = 0.0f; // unnormalized SAH cost, kept up to date by refitTLAS()
+        float builtSAHCost = 0.0f; // SAH cost right after the last full build
+        const float SAHRebuildThreshold = 1.5f; // rebuild once refitting made the SAH cost this much worse
+        const float traversalCost = 1.0f; // SAH cost of visiting an internal node
+        const float leafCost = 2.0f; // SAH cost of entering an instance (ray transform + BLAS root)
+        const int maxTLASUploadGap = 2; // unmodified nodes allowed inside one upload range
+        // GPU TLAS construction
+        TLASBuildMode TLASBuildMode_ = TLAS_BUILD_AUTO;
+        const int GPUTLASBuildThreshold = 256; // instance count from which TLAS_BUILD_AUTO builds on the GPU
+        LBVHBuilder * lbvhBuilder = nullptr; // created on first use
+        bool TLASBuiltOnGPU = false; // whether TLASBuffer currently holds a GPU built TLAS
+        int GPUTLASNodeCount = 0;
+        bool TLASReadbackStale = true; // TLASNodes does not hold the last GPU build yet
+        bool validateNextGPUBuild = true; // compare the first GPU build against the CPU builder
         // shaders
-        Shader * raytraceComputeShader;
+        Shader * raytraceComputeShader = nullptr; // the variant for the loaded scene
+        std::unordered_map<std::string, Shader*> raytraceVariants; // compiled variants, keyed by their feature set
+        RaytraceShaderFeatures raytraceFeatures; // features of the current variant
+        bool shaderSpecialization = true;
+        int workgroupSize = 16;
         Shader * debugAABBShader; // shader for drawing AABBs
         GLuint AABB_VAO, AABB_VBO; // VAO and VBO for drawing AABBs
 
@@ -474,59 +1462,63 @@ namespace GPU_RAYTRACER{
         // ref to camera object, to get the view matrix and the projection matrix
         // to figure the ray directions in the compute shader
         const Camera * camera;
-        // width and height of the render texture
+        // traced resolution (every texture but the render texture), and display resolution (the render texture)
         int width, height;
+        int displayWidth, displayHeight;
         int frameCounter = 0;
+        // sample accumulation
+        TextureRenderTarget * accumulationTexture; // sum of the samples (rgb) and their count (a)
+        TextureRenderTarget * momentsTexture; // sum of the sample luminances (x) and of their squares (y)
+        Shader * resolveShader;
+        int tonemapMode = 0;
+        float exposure = 1.0f;
+        int accumulatedSamples = 0;
+        // frame time budget controller
+        int samplesPerDispatch = 1;
+        const int maxSamplesPerDispatch = 16;
+        float frameTimeBudgetMs = 12.0f; // 0 disables the controller
+        float msPerSample = 0.0f; // smoothed GPU cost of one sample per pixel
+        float lastTraceTimeMs = 0.0f;
+        GPUTimer * traceTimer;
+        std::deque<int> pendingSampleCounts; // sample counts of the timed dispatches still in flight
+        // path tracing
+        const int maxDepth = 4; // bounces per path
+        bool useWavefront = false; // megakernel or wavefront passes
+        WavefrontPathTracer * wavefrontTracer = nullptr; // created on first use
+        // temporal reprojection
+        bool temporalReprojection = true;
+        bool cameraMoved = false; // since the last compute()
+        bool hasPreviousFrame = false; // the previous G-buffer and view-projection are valid
+        TextureRenderTarget * historyTexture; // accumulation of the previous frame
+        TextureRenderTarget * historyMomentsTexture; // luminance moments of the previous frame
+        TextureRenderTarget * positionTextures[2]; // G-buffer ping-pong: world position and hit distance of the primary hits
+        TextureRenderTarget * normalTextures[2]; // G-buffer ping-pong: normal and material type of the primary hits
+        TextureRenderTarget * albedoTexture; // G-buffer: surface color of the primary hits
+        int gbufferIndex = 0; // the G-buffer of the current frame
+        glm::mat4 previousViewProjection = glm::mat4(1.0f);
+        Shader * gbufferShader = nullptr; // created on first use
+        Shader * reprojectShader = nullptr;
+        float maxHistorySamples = 64.0f;
+        float positionTolerance = 0.02f;
+        float normalTolerance = 0.9f;
+        // dynamic resolution
+        bool dynamicResolution = true;
+        float renderScale = 1.0f;
+        float minRenderScale = 0.5f;
+        float maxRenderScale = 1.0f;
+        const float minRenderScaleBound = 0.25f; // lowest minRenderScale accepted
+        const float renderScaleStep = 0.05f; // the scale is a multiple of it
+        const int minFramesBetweenScaleChanges = 30;
+        int framesSinceScaleChange = 0;
+        float upscaleEdgeSharpness = 4.0f; // 0: plain bilinear upsampling
+        bool useCheckerboard = false;
+        // denoising
+        bool useDenoiser = true;
+        SVGFDenoiser * denoiser = nullptr; // created on first use
+        GPUProfiler * profiler = nullptr;
         
-        // a mapping between the Texture object and the texture ID in the raytrace_manager's texture array from 0 to N
-        std::unordered_map<Texture*, int> textureIDMap;
-        std::unordered_set<int> textureIDSet;
-        const int maxTextureCount = 16;
-
-        void addTexture(Texture * texture){
-            if (textureIDMap.find(texture) == textureIDMap.end()){
-                bool inserted = false;
-                for (int i = 0; i < maxTextureCount; i++){
-                    if (textureIDSet.find(i) == textureIDSet.end()){
-                        textureIDSet.insert(i);
-                        textureIDMap[texture] = i;
-                        inserted = true;
-                        break;
-                    }
-                }
-                if (!inserted){
-                    std::cout<<"[addTexture]: error: texture array is full"<<std::endl;
-                }
-            }
-        };
-
-        void removeTexture(Texture * texture){
-            if (textureIDMap.find(texture) != textureIDMap.end()){
-                int textureID = textureIDMap[texture];
-                textureIDSet.erase(textureID);
-                textureIDMap.erase(texture);
-            }
-        };
-
-        GLuint sceneTextureArray; // texture array for the scene textures
-
-        void uploadSceneTextureArray(){
-            // use the textureIDMap to upload the texture array to the compute shader
-            int textureCount = textureIDMap.size();
-            glBindTexture(GL_TEXTURE_2D_ARRAY, sceneTextureArray);
-            // we enforce the texture size to be 1024x1024 and the format to be GL_RGB in the raytracing texture array
-            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, 1024, 1024, textureCount, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-            // upload the textures to the texture array
-            for (auto it = textureIDMap.begin(); it != textureIDMap.end(); it++){
-                Texture * texture = it->first;
-                int textureID = it->second;
-                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, textureID, 1024, 1024, 1, GL_RGB, GL_UNSIGNED_BYTE, texture->getData());
-            }
-
-
-        }
-
-
+        // scene textures, bucketed by size into mipmapped texture array pages
+        TexturePageTable * texturePages;
     };
 
     
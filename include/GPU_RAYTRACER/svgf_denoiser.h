@@ -0,0 +1,159 @@
+#ifndef GPU_RAYTRACER_SVGF_DENOISER_H
+#define GPU_RAYTRACER_SVGF_DENOISER_H
+
+#include <glad/glad.h>
+#include <Shader.h>
+#include <Texture.h>
+#include <GPUProfiler.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace GPU_RAYTRACER{
+
+    // spatiotemporal variance-guided filtering (Schied et al. 2017: "Spatiotemporal Variance-Guided Filtering:
+    // Real-Time Reconstruction for Path-Traced Global Illumination") of the accumulation image
+    // the temporal part is the accumulation itself, kept through camera motion by the reprojection of RaytraceManager,
+    // with the luminance moments accumulated and reprojected alongside the samples; the passes here are the spatial part:
+    // demodulate (color / albedo, variance) -> a-trous iterations (5x5 taps, 1, 2, 4, ... pixels apart) -> modulate (* albedo)
+    // the output has the layout of the accumulation image, so the resolve pass reads either of them
+    class SVGFDenoiser{
+    public:
+        SVGFDenoiser(){
+            demodulateShader = new ComputeShader("shaders/svgf_demodulate.comp");
+            atrousShader = new ComputeShader("shaders/svgf_atrous.comp");
+            modulateShader = new ComputeShader("shaders/svgf_modulate.comp");
+            for (int i = 0; i < 2; i++){
+                illuminationTextures[i] = new TextureRenderTarget(GL_FLOAT, GL_RGBA32F);
+            }
+            outputTexture = new TextureRenderTarget(GL_FLOAT, GL_RGBA32F);
+        };
+
+        ~SVGFDenoiser(){
+            for (int i = 0; i < 2; i++){
+                illuminationTextures[i]->destroy();
+                delete illuminationTextures[i];
+            }
+            outputTexture->destroy();
+            delete outputTexture;
+            delete demodulateShader;
+            delete atrousShader;
+            delete modulateShader;
+        };
+
+        // filter the accumulation into the output texture, every pass is a profiler scope
+        // the G-buffer (position, normal) must be bound to image units 4 and 5, the albedo to image unit 7,
+        // and all of them must hold the primary hits of the current view
+        void denoise(int width, int height, GLuint accumulationTexture, GLuint momentsTexture, float pixelSpreadAngle, GPUProfiler * profiler){
+            if (width == 0 || height == 0){
+                return;
+            }
+            reserve(width, height);
+            for (Shader * shader : {demodulateShader, atrousShader, modulateShader}){
+                shader->use();
+                shader->setInt("imageWidth", width);
+                shader->setInt("imageHeight", height);
+            }
+            for (Shader * shader : {demodulateShader, atrousShader}){
+                shader->use();
+                shader->setFloat("pixelSpreadAngle", pixelSpreadAngle);
+                shader->setFloat("sigmaNormal", sigmaNormal);
+                shader->setFloat("sigmaDepth", sigmaDepth);
+                shader->setFloat("sigmaLuminance", sigmaLuminance);
+            }
+            int groupsX = (width + 15) / 16;
+            int groupsY = (height + 15) / 16;
+
+            {
+                GPUProfileScope scope(profiler, "SVGF demodulate");
+                demodulateShader->use();
+                demodulateShader->setFloat("minHistorySamples", minHistorySamples);
+                glBindImageTexture(2, accumulationTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+                glBindImageTexture(6, momentsTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+                glBindImageTexture(0, illuminationTextures[0]->getTextureRef(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+                glDispatchCompute(groupsX, groupsY, 1);
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            }
+
+            // ping-pong between the two illumination textures, the step doubles every iteration
+            int current = 0;
+            atrousShader->use();
+            for (int i = 0; i < iterations; i++){
+                GPUProfileScope scope(profiler, getAtrousScopeName(i));
+                atrousShader->setInt("stepSize", 1 << i);
+                glBindImageTexture(0, illuminationTextures[current]->getTextureRef(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+                glBindImageTexture(1, illuminationTextures[1 - current]->getTextureRef(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+                glDispatchCompute(groupsX, groupsY, 1);
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                current = 1 - current;
+            }
+
+            {
+                GPUProfileScope scope(profiler, "SVGF modulate");
+                modulateShader->use();
+                glBindImageTexture(0, illuminationTextures[current]->getTextureRef(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+                glBindImageTexture(1, outputTexture->getTextureRef(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+                glDispatchCompute(groupsX, groupsY, 1);
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            }
+            glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+            glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        };
+
+        // the denoised image: rgb is the filtered color, a is 1 (one 'sample')
+        GLuint getOutput() const { return outputTexture->getTextureRef(); }
+
+        // number of a-trous iterations, the filter covers a (1 + 4 * (2^iterations - 1)) pixel wide footprint
+        void setIterations(int _iterations){
+            iterations = std::max(0, std::min(_iterations, maxIterations));
+        };
+        int getIterations() const { return iterations; }
+
+    private:
+        Shader * demodulateShader;
+        Shader * atrousShader;
+        Shader * modulateShader;
+
+        TextureRenderTarget * illuminationTextures[2]; // rgb: demodulated color, a: variance
+        TextureRenderTarget * outputTexture;
+        int textureWidth = 0;
+        int textureHeight = 0;
+
+        static const int maxIterations = 8;
+        int iterations = 4;
+        float minHistorySamples = 4.0f; // below, the variance is estimated spatially
+        float sigmaNormal = 128.0f;
+        float sigmaDepth = 4.0f;
+        float sigmaLuminance = 4.0f;
+        std::vector<std::string> atrousScopeNames;
+
+        const char * getAtrousScopeName(int iteration){
+            if (atrousScopeNames.empty()){
+                for (int i = 0; i < maxIterations; i++){
+                    atrousScopeNames.push_back("SVGF a-trous " + std::to_string(i));
+                }
+            }
+            return atrousScopeNames[iteration].c_str();
+        };
+
+        // (re)allocate the intermediate textures at the image size
+        void reserve(int width, int height){
+            if (width == textureWidth && height == textureHeight){
+                return;
+            }
+            for (int i = 0; i < 2; i++){
+                illuminationTextures[i]->resizeTexture(width, height, 4);
+            }
+            outputTexture->resizeTexture(width, height, 4);
+            textureWidth = width;
+            textureHeight = height;
+        };
+
+        // not copyable
+        SVGFDenoiser(const SVGFDenoiser&) = delete;
+        SVGFDenoiser& operator=(const SVGFDenoiser&) = delete;
+    };
+
+}
+
+#endif
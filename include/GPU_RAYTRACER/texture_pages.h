@@ -0,0 +1,212 @@
+#ifndef GPU_RAYTRACER_TEXTURE_PAGES_H
+#define GPU_RAYTRACER_TEXTURE_PAGES_H
+
+#include <glad/glad.h>
+#include <Texture.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <iostream>
+
+namespace GPU_RAYTRACER{
+
+    // scene textures of the ray tracer, bucketed by size into texture array 'pages'
+    // every texture is stored at the power-of-two size closest above its largest dimension (clamped to [minPageSize, maxPageSize]),
+    // so a page is a GL_TEXTURE_2D_ARRAY whose layers all share one size, each with a full mip chain
+    // the shader finds a texture through the descriptor table (a TBO, one vec4 per texture: page, layer, size, mip count),
+    // indexed by the textureID stored in the material
+    class TexturePageTable{
+    public:
+        static const int minPageSize = 64;
+        static const int maxPageSize = 2048;
+        static const int pageCount = 6; // 64, 128, 256, 512, 1024, 2048, must match MAX_TEXTURE_PAGES in the ray tracing shader
+
+        TexturePageTable(){
+            glGenTextures(pageCount, pageTextures);
+            for (int i = 0; i < pageCount; i++){
+                glBindTexture(GL_TEXTURE_2D_ARRAY, pageTextures[i]);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            glGenBuffers(1, &descriptorBuffer);
+            glBindBuffer(GL_TEXTURE_BUFFER, descriptorBuffer);
+            glGenTextures(1, &descriptorTexture);
+            glBindTexture(GL_TEXTURE_BUFFER, descriptorTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, descriptorBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        };
+
+        ~TexturePageTable(){
+            glDeleteTextures(pageCount, pageTextures);
+            glDeleteTextures(1, &descriptorTexture);
+            glDeleteBuffers(1, &descriptorBuffer);
+        };
+
+        // store the pages in a driver-compressed format (the driver picks its BC/ETC encoding), takes effect on the next upload()
+        void setCompression(bool enable){
+            useCompression = enable;
+        };
+
+        // register a texture, return its textureID (the index into the descriptor table)
+        int addTexture(Texture * texture){
+            auto it = textureIDMap.find(texture);
+            if (it != textureIDMap.end()){
+                return it->second;
+            }
+            if (texture->dataFormat != GL_UNSIGNED_BYTE || texture->getData() == nullptr){
+                std::cout<<"[addTexture]: error: only 8-bit textures with CPU data can be added to the ray tracer"<<std::endl;
+                return -1;
+            }
+            // take the lowest free ID, there is no upper limit
+            int textureID = 0;
+            while (textureIDSet.find(textureID) != textureIDSet.end()){
+                textureID++;
+            }
+            textureIDSet.insert(textureID);
+            textureIDMap[texture] = textureID;
+            return textureID;
+        };
+
+        void removeTexture(Texture * texture){
+            auto it = textureIDMap.find(texture);
+            if (it != textureIDMap.end()){
+                textureIDSet.erase(it->second);
+                textureIDMap.erase(it);
+            }
+        };
+
+        int getTextureID(Texture * texture){
+            auto it = textureIDMap.find(texture);
+            return (it == textureIDMap.end()) ? -1 : it->second;
+        };
+
+        // (re)build all pages and the descriptor table from the registered textures
+        void upload(){
+            std::vector<std::vector<Texture*>> pageLayers(pageCount);
+            std::vector<glm::vec4> descriptors(textureIDSet.empty() ? 1 : (*std::max_element(textureIDSet.begin(), textureIDSet.end()) + 1), glm::vec4(-1.0f));
+            for (auto it = textureIDMap.begin(); it != textureIDMap.end(); it++){
+                int page = getPageIndex(it->first);
+                int pageSize = minPageSize << page;
+                descriptors[it->second] = glm::vec4(page, pageLayers[page].size(), pageSize, getMipCount(pageSize));
+                pageLayers[page].push_back(it->first);
+            }
+
+            size_t totalBytes = 0;
+            for (int page = 0; page < pageCount; page++){
+                totalBytes += uploadPage(page, pageLayers[page]);
+            }
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            glBindBuffer(GL_TEXTURE_BUFFER, descriptorBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, descriptors.size() * sizeof(glm::vec4), descriptors.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+            std::cout<<"[TexturePageTable]: uploaded "<<textureIDMap.size()<<" textures, "<<totalBytes / 1024<<" KB"<<(useCompression ? " before compression" : "")<<std::endl;
+        };
+
+        // bind the pages to texture units firstPageUnit .. firstPageUnit + pageCount - 1, and the descriptor table to descriptorUnit
+        void bind(int firstPageUnit, int descriptorUnit){
+            for (int i = 0; i < pageCount; i++){
+                glActiveTexture(GL_TEXTURE0 + firstPageUnit + i);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, pageTextures[i]);
+            }
+            glActiveTexture(GL_TEXTURE0 + descriptorUnit);
+            glBindTexture(GL_TEXTURE_BUFFER, descriptorTexture);
+        };
+
+    private:
+        GLuint pageTextures[pageCount]; // one texture array per size class
+        GLuint descriptorBuffer; // tbo for the texture descriptors
+        GLuint descriptorTexture; // texture buffer for the texture descriptors
+        bool useCompression = false;
+
+        // a mapping between the Texture object and its textureID from 0 to N
+        std::unordered_map<Texture*, int> textureIDMap;
+        std::unordered_set<int> textureIDSet;
+
+        int getPageIndex(Texture * texture){
+            int size = std::max(texture->width, texture->height);
+            int page = 0;
+            while (page < pageCount - 1 && (minPageSize << page) < size){
+                page++;
+            }
+            return page;
+        };
+
+        int getMipCount(int size){
+            int count = 1;
+            while (size > 1){
+                size >>= 1;
+                count++;
+            }
+            return count;
+        };
+
+        // resize every layer to the page size, build its mip chain on the CPU and upload level by level
+        // (a level of all layers is uploaded in one call, so the driver can compress it when compression is on)
+        // return the uncompressed size of the page
+        size_t uploadPage(int page, const std::vector<Texture*> & layers){
+            glBindTexture(GL_TEXTURE_2D_ARRAY, pageTextures[page]);
+            if (layers.empty()){
+                // keep an empty 1x1 page so that the sampler is still complete
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+                return 0;
+            }
+            int pageSize = minPageSize << page;
+            int mipCount = getMipCount(pageSize);
+            int layerCount = layers.size();
+            GLenum internalFormat = useCompression ? GL_COMPRESSED_RGBA : GL_RGBA8;
+
+            // level 0: every texture resized to the page size and expanded to RGBA
+            std::vector<unsigned char> level((size_t)pageSize * pageSize * 4 * layerCount);
+            std::vector<unsigned char> resized;
+            for (int i = 0; i < layerCount; i++){
+                Texture * texture = layers[i];
+                resized.resize((size_t)pageSize * pageSize * texture->channels);
+                stbir_resize_uint8_linear(static_cast<unsigned char*>(texture->getData()), texture->width, texture->height, 0,
+                                        resized.data(), pageSize, pageSize, 0,
+                                        static_cast<stbir_pixel_layout>(texture->channels));
+                unsigned char * dst = &level[(size_t)i * pageSize * pageSize * 4];
+                for (int p = 0; p < pageSize * pageSize; p++){
+                    const unsigned char * src = &resized[(size_t)p * texture->channels];
+                    dst[4 * p] = src[0];
+                    dst[4 * p + 1] = (texture->channels > 2) ? src[1] : src[0];
+                    dst[4 * p + 2] = (texture->channels > 2) ? src[2] : src[0];
+                    dst[4 * p + 3] = (texture->channels == 4) ? src[3] : ((texture->channels == 2) ? src[1] : 255);
+                }
+            }
+            size_t totalBytes = 0;
+            int size = pageSize;
+            std::vector<unsigned char> nextLevel;
+            for (int mip = 0; mip < mipCount; mip++){
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, mip, internalFormat, size, size, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.data());
+                totalBytes += level.size();
+                if (mip == mipCount - 1){
+                    break;
+                }
+                // next level, downsampled from this one
+                int nextSize = size / 2;
+                nextLevel.resize((size_t)nextSize * nextSize * 4 * layerCount);
+                for (int i = 0; i < layerCount; i++){
+                    stbir_resize_uint8_linear(&level[(size_t)i * size * size * 4], size, size, 0,
+                                            &nextLevel[(size_t)i * nextSize * nextSize * 4], nextSize, nextSize, 0,
+                                            STBIR_RGBA);
+                }
+                level.swap(nextLevel);
+                size = nextSize;
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mipCount - 1);
+            return totalBytes;
+        };
+    };
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef GPU_RAYTRACER_WAVEFRONT_TRACER_H
+#define GPU_RAYTRACER_WAVEFRONT_TRACER_H
+
+#include <glad/glad.h>
+#include <Shader.h>
+#include <vector>
+#include <algorithm>
+
+namespace GPU_RAYTRACER{
+
+    // wavefront path tracer (Laine et al. 2013: "Megakernels Considered Harmful: Wavefront Path Tracing on GPUs")
+    // instead of one big kernel tracing a whole path per thread, every bounce runs small passes connected by queues in SSBOs:
+    // raygen -> extend (closest hit, persistent threads) -> shade (one indirect dispatch per material type) + miss
+    // the queues are filled with atomic counters, and the shade/miss passes are sized on the GPU (glDispatchComputeIndirect),
+    // so the CPU never reads back how many paths are still alive
+    // the finished paths are added to the same accumulation image (image unit 2) as the megakernel
+    class WavefrontPathTracer{
+    public:
+        static const int queueCount = 8; // must match wavefront_common.glsl: 2 extend queues, 4 material queues, miss queue, fetch counter
+        static const int materialTypeCount = 4;
+
+        WavefrontPathTracer(){
+            raygenShader = new ComputeShader("shaders/wavefront_raygen.comp");
+            extendShader = new ComputeShader("shaders/wavefront_extend.comp");
+            shadeShader = new ComputeShader("shaders/wavefront_shade.comp");
+            missShader = new ComputeShader("shaders/wavefront_miss.comp");
+            prepareShader = new ComputeShader("shaders/wavefront_prepare.comp");
+            accumulateShader = new ComputeShader("shaders/wavefront_accumulate.comp");
+
+            glGenBuffers(1, &pathBuffer);
+            glGenBuffers(1, &hitBuffer);
+            glGenBuffers(1, &queueBuffer);
+            glGenBuffers(1, &queueCounterBuffer);
+            glGenBuffers(1, &indirectBuffer);
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, queueCounterBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, queueCount * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirectBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, 3 * queueCount * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        };
+
+        ~WavefrontPathTracer(){
+            glDeleteBuffers(1, &pathBuffer);
+            glDeleteBuffers(1, &hitBuffer);
+            glDeleteBuffers(1, &queueBuffer);
+            glDeleteBuffers(1, &queueCounterBuffer);
+            glDeleteBuffers(1, &indirectBuffer);
+            delete raygenShader;
+            delete extendShader;
+            delete shadeShader;
+            delete missShader;
+            delete prepareShader;
+            delete accumulateShader;
+        };
+
+        // the passes that read the scene (camera, TBOs, textures): the caller sets the scene uniforms on them
+        std::vector<Shader*> getScenePrograms(){
+            return {raygenShader, extendShader, shadeShader, missShader};
+        };
+
+        // trace 'samples' paths per pixel of at most maxDepth bounces, and add them to the accumulation image
+        // the scene textures and the accumulation image must already be bound, the scene uniforms already set
+        void trace(int width, int height, int samples, int maxDepth, bool clearAccumulation){
+            int pathCount = width * height;
+            if (pathCount == 0){
+                return;
+            }
+            reserve(pathCount);
+            int pathGroupCount = (pathCount + workgroupSize - 1) / workgroupSize;
+            int extendGroupCount = std::min(persistentGroupCount, pathGroupCount);
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pathBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, hitBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, queueBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, queueCounterBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, indirectBuffer);
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, indirectBuffer);
+            for (Shader * shader : {raygenShader, extendShader, shadeShader, missShader, prepareShader, accumulateShader}){
+                shader->use();
+                shader->setInt("queueCapacity", pathCount);
+            }
+
+            for (int sample = 0; sample < samples; sample++){
+                // all queues start empty
+                GLuint zero = 0;
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, queueCounterBuffer);
+                glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+                // camera rays into the first extend queue
+                raygenShader->use();
+                raygenShader->setInt("sampleIndex", sample);
+                glDispatchCompute(pathGroupCount, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+                for (int depth = 0; depth < maxDepth; depth++){
+                    int inputQueue = depth % 2;
+                    int outputQueue = 1 - inputQueue;
+                    // closest hits, sorted into the material and miss queues
+                    extendShader->use();
+                    extendShader->setInt("inputQueue", inputQueue);
+                    glDispatchCompute(extendGroupCount, 1, 1);
+                    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                    // size the shading dispatches
+                    prepareShader->use();
+                    prepareShader->setInt("stage", 0);
+                    prepareShader->setInt("outputQueue", outputQueue);
+                    glDispatchCompute(1, 1, 1);
+                    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+                    // one coherent dispatch per material type
+                    shadeShader->use();
+                    shadeShader->setInt("outputQueue", outputQueue);
+                    shadeShader->setBool("lastBounce", depth == maxDepth - 1);
+                    for (int materialType = 0; materialType < materialTypeCount; materialType++){
+                        shadeShader->setInt("materialType", materialType);
+                        glDispatchComputeIndirect(indirectArgsOffset(materialQueue + materialType));
+                    }
+                    missShader->use();
+                    glDispatchComputeIndirect(indirectArgsOffset(missQueue));
+                    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                    // empty the material and miss queues for the next bounce
+                    prepareShader->use();
+                    prepareShader->setInt("stage", 1);
+                    glDispatchCompute(1, 1, 1);
+                    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                }
+
+                // add the finished paths to the accumulation image
+                accumulateShader->use();
+                accumulateShader->setInt("imageWidth", width);
+                accumulateShader->setInt("imageHeight", height);
+                accumulateShader->setBool("clearAccumulation", clearAccumulation && sample == 0);
+                glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+                glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+            }
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        };
+
+    private:
+        Shader * raygenShader;
+        Shader * extendShader;
+        Shader * shadeShader;
+        Shader * missShader;
+        Shader * prepareShader;
+        Shader * accumulateShader;
+
+        GLuint pathBuffer; // PathState per path (80 bytes)
+        GLuint hitBuffer; // PathHit per path (48 bytes)
+        GLuint queueBuffer; // queueCount queues of path indices, pathCapacity each
+        GLuint queueCounterBuffer; // number of paths in every queue
+        GLuint indirectBuffer; // indirect dispatch arguments (x, y, z) of every queue
+        int pathCapacity = 0;
+
+        const int workgroupSize = 64; // WAVEFRONT_GROUP_SIZE in wavefront_common.glsl
+        const int persistentGroupCount = 256; // workgroups of the persistent extend pass
+        static const int materialQueue = 2; // QUEUE_MATERIAL
+        static const int missQueue = 6; // QUEUE_MISS
+        static const int pathStateSize = 80;
+        static const int pathHitSize = 48;
+
+        GLintptr indirectArgsOffset(int queue){
+            return queue * 3 * sizeof(GLuint);
+        };
+
+        // grow the path and queue buffers to hold one path per pixel
+        void reserve(int pathCount){
+            if (pathCount <= pathCapacity){
+                return;
+            }
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, pathBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)pathCount * pathStateSize, nullptr, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, hitBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)pathCount * pathHitSize, nullptr, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, queueBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)pathCount * queueCount * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            pathCapacity = pathCount;
+        };
+
+        // not copyable
+        WavefrontPathTracer(const WavefrontPathTracer&) = delete;
+        WavefrontPathTracer& operator=(const WavefrontPathTracer&) = delete;
+    };
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef GEOMETRY_REGISTRY_H
+#define GEOMETRY_REGISTRY_H
+
+#include <glad/glad.h>
+#include <MeshPool.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <iostream>
+
+// a shape in the MeshPool, shared by the objects drawing the same shape
+struct SharedGeometry {
+    int mesh = -1; // MeshPool handle
+    std::vector<int> lodMeshes; // MeshPool handles of the coarser levels of detail, sharing the vertices of 'mesh'
+    int users = 0;
+};
+
+// the geometries shared between the objects with identical shapes (tessellated spheres with the same parameters,
+// meshes loaded from the same file), so that such objects upload their vertices once and draw the same MeshPool range,
+// which also lets the render queue draw them together with one instanced draw call
+// the geometries are reference counted: their range of the pool is released with the last object using them
+// the registry is changed on the main thread (it owns pool ranges), contains() may also be called from the loading tasks
+class GeometryRegistry
+{
+public:
+    static GeometryRegistry & get()
+    {
+        static GeometryRegistry registry;
+        return registry;
+    }
+
+    // the geometry registered under 'key' with one more user, nullptr if there is none yet
+    const SharedGeometry * acquire(const std::string & key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests++;
+        auto it = geometries.find(key);
+        if (it == geometries.end()) {
+            return nullptr;
+        }
+        it->second.users++;
+        return &it->second;
+    }
+
+    // register the mesh (and its levels of detail) the first user just added to the pool, the registry owns them from now on
+    void add(const std::string & key, int mesh, const std::vector<int> & lodMeshes = {})
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        SharedGeometry & geometry = geometries[key];
+        geometry.mesh = mesh;
+        geometry.lodMeshes = lodMeshes;
+        geometry.users = 1;
+    }
+
+    // one user less, the mesh leaves the pool with the last one
+    void release(const std::string & key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = geometries.find(key);
+        if (it == geometries.end()) {
+            std::cout << "[GeometryRegistry]: error: releasing unknown geometry " << key << std::endl;
+            return;
+        }
+        if (--it->second.users > 0) {
+            return;
+        }
+        for (int lodMesh : it->second.lodMeshes) {
+            MeshPool::get().release(lodMesh);
+        }
+        MeshPool::get().release(it->second.mesh);
+        geometries.erase(it);
+    }
+
+    // whether a geometry is registered under 'key', so a loader can skip building what acquire() will find
+    bool contains(const std::string & key) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return geometries.count(key) > 0;
+    }
+
+    int getGeometryCount() const { return geometries.size(); }
+
+    void printStats() const
+    {
+        std::cout << "[GeometryRegistry]: " << requests << " shared geometry requests served by " << geometries.size() << " geometries" << std::endl;
+    }
+
+private:
+    std::map<std::string, SharedGeometry> geometries; // key: shape and its parameters, or file and mesh index
+    int requests = 0;
+    mutable std::mutex mutex; // guards geometries against contains() from other threads
+
+    GeometryRegistry() {}
+
+    GeometryRegistry(const GeometryRegistry&) = delete;
+    GeometryRegistry& operator=(const GeometryRegistry&) = delete;
+};
+
+#endif
@@ -8,6 +8,12 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <Texture.h>
+#include <ObjectDataBuffer.h>
+#include <GeometryRegistry.h>
+#include <MeshSimplifier.h>
+#include <MeshOptimizer.h>
+
+#include <sstream>
 
 // GObject: G stands for Graphics, the base class for all graphics objects (mesh, sphere, etc.)
 // it contains the basic opengl objects (VAO, VBO, EBO) and a shader reference, necessary for rendering
@@ -118,31 +124,176 @@ public:
 	glm::mat4 model;
 	glm::vec4 color;
 	SkyboxTexture * skyboxTexture = nullptr;
-	void prepareDraw(const RenderContext * context) override {
-		// set the light info
-		shader->use();
-		shader->setVec3("lightPos", context->lightPos);
-		shader->setVec3("lightColor", context->lightColor);
-		shader->setVec3("ambientLightColor", context->ambientColor);
-		shader->setInt("numOfLights", context->lightCount);
-	}
+	// the transform and the forward shading material of the object, its record in the ObjectDataBuffer
+	// (the lights are per frame and live in the RenderInfo uniform block)
+	ObjectData objectData;
+	int objectIndex = -1; // slot in the ObjectDataBuffer, taken on the first draw
+	int mesh = -1; // the geometry of the object in the MeshPool, -1 if the object owns its buffers (VAO, VBO)
+	std::string geometryKey; // key of the mesh in the GeometryRegistry, empty if the object does not share it
+	std::vector<int> lodMeshes; // coarser levels of detail of 'mesh' in the MeshPool, level i + 1 is lodMeshes[i]
+	int lodLevel = 0; // the level of detail drawn, selected by the renderer from the size of the object on screen
 	virtual void setModel(glm::mat4 _model) {
 		model = _model;
+		writeObjectData();
 	}
 	virtual void setColor(glm::vec4 _color) {
 		color = _color;
+		writeObjectData();
 	}
 	virtual void setSkyboxTexture(SkyboxTexture * _texture) {
 		skyboxTexture = _texture;
 	}
+	void setTexture(Texture * _texture) override {
+		GObject::setTexture(_texture);
+		writeObjectData();
+	}
+	// the samplers are on fixed texture units: the object texture on 0, the skybox on 1
+	void setShader(Shader * _shader) override {
+		shader = _shader;
+		shader->use();
+		shader->setInt("texture1", 0);
+		shader->setInt("skyboxTexture", 1);
+	}
+	// the shading parameters of the material type, they are stored per object and not in the (shared) program
+	virtual void setMaterialParameters(int materialType, float refractionRatio, float averageSlope) {
+		objectData.materialType = materialType;
+		objectData.refractionRatio = refractionRatio;
+		objectData.averageSlope = averageSlope;
+		writeObjectData();
+	}
+	// update the record of the object, it reaches the GPU with the next ObjectDataBuffer::upload()
+	void writeObjectData() {
+		if (objectIndex < 0) {
+			return;
+		}
+		objectData.model = model;
+		objectData.normalMatrix = glm::transpose(glm::inverse(model));
+		objectData.color = color;
+		objectData.useTexture = hasTexture ? 1 : 0;
+		ObjectDataBuffer::get().write(objectIndex, objectData);
+	}
+	// the slot of the object in the ObjectDataBuffer, taken and written on first use (it reaches the GPU with the next upload)
+	int getObjectIndex() {
+		if (objectIndex < 0) {
+			objectIndex = ObjectDataBuffer::get().allocate();
+			writeObjectData();
+		}
+		return objectIndex;
+	}
+	// bind the textures and select the record of the object for the next draw
+	void bindObjectData() {
+		if (objectIndex < 0) {
+			// first draw: the record was not part of the last upload
+			getObjectIndex();
+			ObjectDataBuffer::get().upload();
+		}
+		bindTextures();
+		shader->setInt("objectIndex", objectIndex);
+	}
+	void bindTextures() {
+		if (hasTexture) {
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, texture->getTextureRef());
+		}
+		if (skyboxTexture != nullptr) {
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture->getTextureRef());
+			glActiveTexture(GL_TEXTURE0);
+		}
+	}
+	void releaseObjectData() {
+		if (objectIndex >= 0) {
+			ObjectDataBuffer::get().release(objectIndex);
+			objectIndex = -1;
+		}
+	}
+	// put the vertices (8 floats each: position, normal, uv) and indices in the MeshPool, shared under geometryKey if it is set
+	// lodIndices: the triangles of the coarser levels of detail, indexing the same vertices
+	void addGeometry(const std::vector<GLfloat> & vertices, const std::vector<GLuint> & indices, const std::vector<std::vector<GLuint>> & lodIndices = {}) {
+		mesh = MeshPool::get().add(vertices, indices);
+		for (const std::vector<GLuint> & levelIndices : lodIndices) {
+			lodMeshes.push_back(MeshPool::get().addIndices(mesh, levelIndices));
+		}
+		if (!geometryKey.empty()) {
+			GeometryRegistry::get().add(geometryKey, mesh, lodMeshes);
+		}
+	}
+	// use the mesh registered under geometryKey, false if there is none yet
+	bool acquireGeometry() {
+		const SharedGeometry * geometry = GeometryRegistry::get().acquire(geometryKey);
+		if (geometry == nullptr) {
+			return false;
+		}
+		mesh = geometry->mesh;
+		lodMeshes = geometry->lodMeshes;
+		return true;
+	}
+	// delete the buffers of the object, or give up its mesh in the pool
+	void releaseGeometry() {
+		if (!geometryKey.empty()) {
+			GeometryRegistry::get().release(geometryKey);
+		}
+		else if (mesh >= 0) {
+			for (int lodMesh : lodMeshes) {
+				MeshPool::get().release(lodMesh);
+			}
+			MeshPool::get().release(mesh);
+		}
+		else {
+			glDeleteVertexArrays(1, &VAO);
+			glDeleteBuffers(1, &VBO);
+		}
+		mesh = -1;
+		lodMeshes.clear();
+		lodLevel = 0;
+	}
+
+	// levels of detail: 0 is the full geometry, every next level has about half of the triangles of the previous one
+	virtual int getLODCount() const {
+		return 1 + lodMeshes.size();
+	}
+	virtual void setLODLevel(int level) {
+		lodLevel = std::max(0, std::min(level, getLODCount() - 1));
+	}
+	// the pool mesh of the selected level of detail; an object without pool geometry of its own (a GModel, whose level
+	// only follows its meshes) returns 'mesh'
+	int getLODMesh() const {
+		if (mesh < 0 || lodLevel == 0 || lodMeshes.empty()) {
+			return mesh;
+		}
+		return lodMeshes[std::min<size_t>(lodLevel, lodMeshes.size()) - 1];
+	}
+	int getLODTriangleCount(int level) const {
+		if (mesh < 0) {
+			return 0;
+		}
+		level = std::max(0, std::min(level, getLODCount() - 1));
+		return MeshPool::get().getRange(level == 0 ? mesh : lodMeshes[level - 1]).indexCount / 3;
+	}
+
+	// batching: the objects of a batched draw share the program and the textures and draw MeshPool geometry,
+	// they select their records of the ObjectDataBuffer through the per-draw object index (vertex attribute 3)
+	bool canBatchWith(const GMVPObject * other) const {
+		return mesh >= 0 && other->mesh >= 0 && shader == other->shader
+			&& hasTexture == other->hasTexture && (!hasTexture || texture == other->texture) && skyboxTexture == other->skyboxTexture;
+	}
+	// whether the two objects can be drawn by one instanced draw: batchable, with the same geometry at the same level of detail
+	bool canDrawInstancedWith(const GMVPObject * other) const {
+		return canBatchWith(other) && getLODMesh() == other->getLODMesh();
+	}
+	// bind the program and the textures for a batched draw of the objects that canBatchWith() this one
+	void bindBatch() {
+		shader->use();
+		bindTextures();
+		shader->setInt("objectIndex", -1);
+	}
 };
 
 
-// the sphere object's VBO data is its object space vertex data
+// the sphere object's vertex data (in the MeshPool) is its object space vertex data
 // by default, the sphere is at the origin, with radius 1
 class GSphere : public GMVPObject {
 public:
-	GLuint EBO;
 	float radius;
 	glm::vec3 center;
 	GSphere() {
@@ -158,33 +309,28 @@ public:
 	};
 
 	void Delete() override {
-		glDeleteVertexArrays(1, &VAO);
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &EBO);
+		releaseGeometry();
+		releaseObjectData();
 	};
 
 
 	void draw() override {
 		shader->use();
-		if (hasTexture) {
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, texture->getTextureRef());
-			shader->setInt("texture1", 0);
-		}
-		shader->setBool("useTexture", hasTexture);
-		shader->setMat4("model", model);
-		shader->setVec4("color", color);
-		shader->setInt("skyboxTexture", skyboxTexture->getTextureRef());
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, 10800, GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		bindObjectData();
+		MeshPool::get().draw(getLODMesh());
 	}
 	
 
+	// the tessellation only depends on the center and the radius, the spheres with the same ones share their mesh
 	void generateBufferResource(){
-		std::vector<GLfloat> sphereVertices;
 		int sectors = 60;
 		int stacks = 30;
+		geometryKey = "sphere " + std::to_string(sectors) + "x" + std::to_string(stacks) + " " + std::to_string(center.x) + " "
+			+ std::to_string(center.y) + " " + std::to_string(center.z) + " " + std::to_string(radius);
+		if (acquireGeometry()) {
+			return;
+		}
+		std::vector<GLfloat> sphereVertices;
 		int num = (stacks * 2) * sectors * 3;
 		for (int i = 0; i <= stacks; ++i) {
 			float stackAngle = glm::pi<float>() / 2.0f - i * glm::pi<float>() / stacks;
@@ -226,22 +372,8 @@ public:
 				sphereIndices.push_back(bottom + 1);
 			}
 		}
-		glGenBuffers(1, &EBO);
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO); 
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * sphereVertices.size(), sphereVertices.data(), GL_STATIC_DRAW); 
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0); // set vertex attribute pointers: position
-		glEnableVertexAttribArray(0); // activate vertex attribute
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float))); // set vertex attribute pointers: normal
-		glEnableVertexAttribArray(1); // activate vertex attribute
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float))); // set vertex attribute pointers: uv
-		glEnableVertexAttribArray(2); // activate vertex attribute
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); // bind EBO
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * sphereIndices.size(), sphereIndices.data(), GL_STATIC_DRAW); // copy the index data to EBO
-		glBindVertexArray(0);
+		// same layout as the pool: position, normal, uv
+		addGeometry(sphereVertices, sphereIndices);
 	}
 };
 
@@ -274,19 +406,12 @@ glm::vec2 t0,t1,t2;
 	void Delete() override {
 		glDeleteVertexArrays(1, &VAO);
 		glDeleteBuffers(1, &VBO);
+		releaseObjectData();
 	};
 
 	void draw() override {
 		shader->use();
-		if (hasTexture) {
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, texture->getTextureRef());
-			shader->setInt("texture1", 0);
-		}
-		shader->setBool("useTexture", hasTexture);
-		shader->setMat4("model", model);
-		shader->setVec4("color", color);
-		shader->setInt("skyboxTexture", skyboxTexture->getTextureRef());
+		bindObjectData();
 		glBindVertexArray(VAO);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 		glBindVertexArray(0);
@@ -423,15 +548,13 @@ class GMesh : public GMVPObject {
 	std::vector<glm::vec2> uvs;
 	std::vector<GLuint> indices;
 
-	// render data
-	// same as any other object, we have a VAO, VBO
-	// the only difference is that we have a EBO now
-	GLuint EBO;
-	
-	
+	// render data: the mesh lives in the MeshPool, the VAO and VBO of GObject are unused
+	std::vector<std::vector<GLuint>> pendingLODs; // built by a constructor without upload (unless the mesh was registered), for uploadGeometry()
+	bool hasPendingLODs = false;
 
-	// constructor
-	GMesh(aiMesh* mesh)
+	// constructor, the meshes with the same non-empty geometryKey (e.g. file and mesh index) share their pool mesh
+	// without 'upload' it makes no GL call (it may run on a worker thread), uploadGeometry() must follow on the main thread
+	GMesh(aiMesh* mesh, const std::string & _geometryKey = "", bool upload = true)
 	{
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
@@ -469,26 +592,38 @@ class GMesh : public GMVPObject {
 				indices.push_back(face.mIndices[j]);
 		}
 
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
-		// bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-		glBindVertexArray(VAO);
-
-		unsigned int vertex_size = 0;
-		// position attribute
-		vertex_size += sizeof(glm::vec3);
 		// normal attribute
 		if (normals.size() == 0) {
 			generateSmoothNormals();
 			//generateNormal();	
 		}
-		vertex_size += sizeof(glm::vec3);
-		if (uvs.size() > 0) {
-			vertex_size += sizeof(glm::vec2);
+		// before anything reads the arrays, so the pool and the ray tracers see the same vertex and triangle order
+		// (it is deterministic: a mesh found in the pool below was laid out the same way)
+		optimizeLayout();
+		geometryKey = _geometryKey;
+		if (upload) {
+			uploadGeometry();
+		}
+		else if (geometryKey.empty() || !GeometryRegistry::get().contains(geometryKey)) {
+			// a shared mesh already in the pool brings its levels of detail, only a new one pays for the simplification
+			pendingLODs = buildLODs();
+			hasPendingLODs = true;
+		}
+	}
+
+	// put the mesh and its levels of detail in the MeshPool (GL, main thread)
+	void uploadGeometry() {
+		std::vector<std::vector<GLuint>> lodIndices;
+		lodIndices.swap(pendingLODs);
+		bool lodsBuilt = hasPendingLODs;
+		hasPendingLODs = false;
+		// the vertex data on the CPU is kept (the ray tracers read it), the mesh may already be in the pool
+		if (!geometryKey.empty() && acquireGeometry()) {
+			return;
 		}
 
-		// combine all the data into a single array as interleaved array, then upload it into the VBO
+		// combine all the data into a single array as interleaved array in the layout of the pool:
+		// position, normal(force exist by generating), uv(zero if the mesh has none)
 		std::vector<float> interleaved_data;
 		for (unsigned int i = 0; i < positions.size(); i++) {
 			interleaved_data.push_back(positions[i].x);
@@ -497,32 +632,29 @@ class GMesh : public GMVPObject {
 			interleaved_data.push_back(normals[i].x);
 			interleaved_data.push_back(normals[i].y);
 			interleaved_data.push_back(normals[i].z);
-			if (uvs.size() > 0) {
-				interleaved_data.push_back(uvs[i].x);
-				interleaved_data.push_back(uvs[i].y);
-			}
+			interleaved_data.push_back(uvs.size() > 0 ? uvs[i].x : 0.0f);
+			interleaved_data.push_back(uvs.size() > 0 ? uvs[i].y : 0.0f);
 		}
-		
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, interleaved_data.size() * sizeof(float), &interleaved_data[0], GL_STATIC_DRAW);
-		
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+		addGeometry(interleaved_data, indices, lodsBuilt ? lodIndices : buildLODs());
+	}
 
-		// we specify the layout of the vertex data: position, normal(force exist by generating), uv(might not exist)
-		// position attribute
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertex_size, (void*)0);
-		glEnableVertexAttribArray(0);
-		// normal attribute
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vertex_size, (void*)sizeof(glm::vec3));
-		glEnableVertexAttribArray(1);
-		// uv attribute
-		if (uvs.size() > 0) {		
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, vertex_size, (void*)(2*sizeof(glm::vec3)));
-			glEnableVertexAttribArray(2);		
+	// the levels of detail, each simplified from the previous one to about half of its triangles, until the mesh is small
+	// or cannot be simplified within maxLODError (relative to its size) any more
+	static const int maxLODCount = 4;
+	static const int minLODTriangles = 64;
+	static constexpr float maxLODError = 0.02f;
+	std::vector<std::vector<GLuint>> buildLODs() const {
+		std::vector<std::vector<GLuint>> levels;
+		const std::vector<GLuint> * previous = &indices;
+		while (levels.size() + 1 < maxLODCount && previous->size() / 3 >= 2 * minLODTriangles) {
+			std::vector<GLuint> level = MeshSimplifier::simplify(positions, *previous, previous->size() / 6, maxLODError);
+			if (level.empty() || level.size() * 10 > previous->size() * 9) {
+				break;
+			}
+			levels.push_back(MeshOptimizer::optimizeVertexCache(level, positions.size()));
+			previous = &levels.back();
 		}
-	
-		glBindVertexArray(0);
+		return levels;
 	}
 
 	// only load the first mesh in the file, not recommended, use Model class instead
@@ -542,6 +674,22 @@ class GMesh : public GMVPObject {
 
 
 
+	// reorder the triangles for the post-transform vertex cache, then the vertices by first use for the vertex fetch
+	void optimizeLayout() {
+		VertexCacheStats before = MeshOptimizer::analyzeVertexCache(indices, positions.size());
+		indices = MeshOptimizer::optimizeVertexCache(indices, positions.size());
+		std::vector<GLuint> remap = MeshOptimizer::optimizeVertexFetch(indices, positions.size());
+		MeshOptimizer::remapVertices(positions, remap);
+		MeshOptimizer::remapVertices(normals, remap);
+		MeshOptimizer::remapVertices(uvs, remap);
+		VertexCacheStats after = MeshOptimizer::analyzeVertexCache(indices, positions.size());
+		// one write, the meshes may be imported on several threads
+		std::ostringstream line;
+		line << "[GMesh]: " << indices.size() / 3 << " triangles, ACMR " << before.ACMR << " -> " << after.ACMR
+			<< ", ATVR " << before.ATVR << " -> " << after.ATVR << "\n";
+		std::cout << line.str() << std::flush;
+	}
+
 	// if we don't have normal, we can generate it
 	void generateNormal() {
 		if (normals.size() == 0) {
@@ -586,26 +734,15 @@ class GMesh : public GMVPObject {
 	void draw() override
 	{
 		shader->use();
-		if (hasTexture) {
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, texture->getTextureRef());
-			shader->setInt("texture1", 0);
-		}
-		shader->setBool("useTexture", hasTexture);
-		shader->setMat4("model", model);
-		shader->setVec4("color", color); // set the color
-		shader->setInt("skyboxTexture", skyboxTexture->getTextureRef());
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		bindObjectData();
+		MeshPool::get().draw(getLODMesh());
 		
 	}
 
 	void Delete() override
 	{
-		glDeleteVertexArrays(1, &VAO);
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &EBO);
+		releaseGeometry();
+		releaseObjectData();
 	}
 
 
@@ -618,7 +755,8 @@ class GMesh : public GMVPObject {
 class GModel : public GMVPObject {
 	public:
 	std::vector<GMesh*> meshes;
-	GModel(std::string const& path)
+	// without 'upload' it makes no GL call (it may run on a worker thread), uploadGeometry() must follow on the main thread
+	GModel(std::string const& path, bool upload = true)
 	{
 		Assimp::Importer importer;
 		// noticing that we use aiProcessPreset_TargetRealtime_Quality, which is a combination of multiple flags
@@ -630,21 +768,56 @@ class GModel : public GMVPObject {
 			std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
 			return;
 		}
+		// the meshes of a file loaded before share the buffers of its first load
 		for (unsigned int i = 0; i < scene->mNumMeshes; i++)
 		{
 			aiMesh* mesh = scene->mMeshes[i];
-			GMesh *m = new GMesh(mesh);
+			GMesh *m = new GMesh(mesh, path + "#" + std::to_string(i), false);
 			meshes.push_back(m);
 		}
+		if (upload) {
+			uploadGeometry();
+		}
+	}
 
-		std::cout<<"model loaded, mesh count: "<< meshes.size() <<std::endl;
-		
+	// put the meshes in the MeshPool (GL, main thread)
+	void uploadGeometry() {
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i]->uploadGeometry();
+		std::cout<<"model loaded, mesh count: "<< meshes.size() <<", triangles per LOD:";
+		for (int level = 0; level < getLODCount(); level++) {
+			int triangles = 0;
+			for (unsigned int i = 0; i < meshes.size(); i++)
+				triangles += meshes[i]->getLODTriangleCount(level);
+			std::cout << (level == 0 ? " " : " / ") << triangles;
+		}
+		std::cout << std::endl;
+	}
+
+	// the levels of detail of the meshes, a mesh with fewer levels draws its coarsest one
+	int getLODCount() const override {
+		int count = 1;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			count = std::max(count, meshes[i]->getLODCount());
+		return count;
+	}
+
+	void setLODLevel(int level) override {
+		GMVPObject::setLODLevel(level);
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i]->setLODLevel(level);
 	}
 
 	void setColor(glm::vec4 _color) override{
 		color = _color;
 		for (unsigned int i = 0; i < meshes.size(); i++)
-			meshes[i]->color = _color;
+			meshes[i]->setColor(_color);
+	}
+
+	void setMaterialParameters(int materialType, float refractionRatio, float averageSlope) override {
+		GMVPObject::setMaterialParameters(materialType, refractionRatio, averageSlope);
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i]->setMaterialParameters(materialType, refractionRatio, averageSlope);
 	}
 
 	void setSkyboxTexture(SkyboxTexture * _texture) override {
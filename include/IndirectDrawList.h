@@ -0,0 +1,132 @@
+#ifndef INDIRECT_DRAW_LIST_H
+#define INDIRECT_DRAW_LIST_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <Shader.h>
+#include <MeshPool.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+// one draw of a MeshPool mesh for one object
+struct DrawRecord {
+    GLuint indexCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLint objectIndex; // record in the ObjectDataBuffer
+    glm::vec4 boundsMin; // world space AABB, min > max if the object has none (it is never occluded then)
+    glm::vec4 boundsMax;
+};
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// the batched draws of a frame: the renderer adds a record per object, upload() sends them in one glBufferSubData
+// and a compute pass writes their indirect commands, then the batches are submitted with glMultiDrawElementsIndirect
+// (or, for the instances of one mesh, with one glDrawElementsInstancedBaseVertexBaseInstance)
+// the record buffer is also the source of the per-draw object index attribute of the MeshPool VAO:
+// draw i has base instance i, so its vertices read the object index of record i
+class IndirectDrawList {
+public:
+    static const GLuint recordBinding = 3; // shader storage buffer bindings of the command pass
+    static const GLuint commandBinding = 4;
+
+    IndirectDrawList() {
+        commandShader = new ComputeShader("shaders/indirect_commands.comp");
+        glGenBuffers(1, &recordBuffer);
+        glGenBuffers(1, &commandBuffer);
+    }
+    ~IndirectDrawList() {
+        glDeleteBuffers(1, &recordBuffer);
+        glDeleteBuffers(1, &commandBuffer);
+        delete commandShader;
+    }
+
+    void clear() { records.clear(); }
+
+    // a draw of the pool mesh for the object, returns its index
+    int add(int mesh, GLint objectIndex, const glm::vec3 & AA, const glm::vec3 & BB) {
+        const MeshRange & range = MeshPool::get().getRange(mesh);
+        records.push_back({(GLuint)range.indexCount, range.firstIndex, range.baseVertex, objectIndex, glm::vec4(AA, 0.0f), glm::vec4(BB, 0.0f)});
+        return records.size() - 1;
+    }
+
+    int size() const { return records.size(); }
+    GLuint getRecordBuffer() const { return recordBuffer; }
+
+    // send the records and write the commands of all of them
+    // with 'useVisibility', only the objects marked in the visibility buffer of the OcclusionCuller get an instance
+    void upload(bool useVisibility = false) {
+        if (records.empty()) {
+            return;
+        }
+        reserve(records.size());
+        glBindBuffer(GL_ARRAY_BUFFER, recordBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, records.size() * sizeof(DrawRecord), records.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        commandShader->use();
+        commandShader->setInt("drawCount", records.size());
+        commandShader->setBool("useVisibility", useVisibility);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, recordBinding, recordBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, commandBinding, commandBuffer);
+        glDispatchCompute((records.size() + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+    }
+
+    // draws [first, first + count) with one multi-draw, with the current program
+    // the commands are the ones of upload(), or the ones another pass wrote for the records in 'commands'
+    void drawIndirect(int first, int count, GLuint commands = 0) const {
+        glBindVertexArray(MeshPool::get().getVertexArray());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands != 0 ? commands : commandBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // draws [first, first + count), all of the same mesh, as the instances of one draw
+    void drawInstanced(int first, int count) const {
+        const DrawRecord & record = records[first];
+        glBindVertexArray(MeshPool::get().getVertexArray());
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, record.indexCount, GL_UNSIGNED_INT,
+            (void*)(record.firstIndex * sizeof(GLuint)), count, record.baseVertex, first);
+        glBindVertexArray(0);
+    }
+
+private:
+    Shader * commandShader;
+    GLuint recordBuffer = 0;
+    GLuint commandBuffer = 0;
+    int capacity = 0; // in draws
+    std::vector<DrawRecord> records;
+
+    void reserve(int count) {
+        if (count <= capacity) {
+            return;
+        }
+        if (capacity == 0) {
+            // the object index attribute of the pool VAO reads the record buffer (glBufferData keeps the buffer name)
+            MeshPool::get().setDrawRecordBuffer(recordBuffer, sizeof(DrawRecord), offsetof(DrawRecord, objectIndex));
+        }
+        capacity = std::max(256, 2 * count);
+        glBindBuffer(GL_ARRAY_BUFFER, recordBuffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(DrawRecord), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, commandBuffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // not copyable
+    IndirectDrawList(const IndirectDrawList&) = delete;
+    IndirectDrawList& operator=(const IndirectDrawList&) = delete;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// efficiency of an index order with a FIFO post-transform vertex cache
+struct VertexCacheStats {
+    float ACMR = 0.0f; // average cache miss ratio: transformed vertices per triangle, 0.5 at best for a large regular mesh
+    float ATVR = 0.0f; // average transformed vertex ratio: transformed vertices per vertex, 1 at best
+};
+
+// the index and vertex order of the imported meshes:
+// - the triangles are reordered for the post-transform vertex cache with the linear-speed algorithm of Tom Forsyth
+//   ("Linear-Speed Vertex Cache Optimisation"), a greedy walk emitting the triangle whose vertices score best, the score
+//   favoring the vertices recently used (still in the cache) and the ones with few triangles left (no isolated leftovers)
+// - the vertices are then renumbered in the order the triangles use them first, so the vertex fetch reads the buffer
+//   mostly forward
+class MeshOptimizer {
+public:
+    static const int simulatedCacheSize = 16; // for the statistics, the size of the FIFO of common hardware
+
+    // the triangles of 'indices' in vertex cache friendly order
+    static std::vector<GLuint> optimizeVertexCache(const std::vector<GLuint> & indices, int vertexCount) {
+        int triangleCount = indices.size() / 3;
+        // the triangles of every vertex, the emitted ones are moved past the end of the vertex's list
+        std::vector<int> triangleOffsets(vertexCount + 1, 0);
+        for (GLuint index : indices) {
+            triangleOffsets[index + 1]++;
+        }
+        for (int v = 0; v < vertexCount; v++) {
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        }
+        std::vector<int> remainingTriangles(vertexCount, 0);
+        std::vector<int> vertexTriangles(indices.size());
+        for (int t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                GLuint v = indices[3 * t + k];
+                vertexTriangles[triangleOffsets[v] + remainingTriangles[v]++] = t;
+            }
+        }
+
+        std::vector<int> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (int v = 0; v < vertexCount; v++) {
+            vertexScores[v] = vertexScore(-1, remainingTriangles[v]);
+        }
+        std::vector<float> triangleScores(triangleCount);
+        for (int t = 0; t < triangleCount; t++) {
+            triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+        }
+        std::vector<bool> emitted(triangleCount, false);
+
+        std::vector<GLuint> optimized;
+        optimized.reserve(indices.size());
+        std::vector<GLuint> cache, nextCache;
+        int bestTriangle = -1;
+        int scanCursor = 0; // the triangles before it are all emitted
+        for (int emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+            if (bestTriangle < 0) {
+                // no candidate around the cache: the best remaining triangle overall
+                while (emitted[scanCursor]) {
+                    scanCursor++;
+                }
+                bestTriangle = scanCursor;
+                for (int t = scanCursor + 1; t < triangleCount; t++) {
+                    if (!emitted[t] && triangleScores[t] > triangleScores[bestTriangle]) {
+                        bestTriangle = t;
+                    }
+                }
+            }
+            const GLuint * corners = &indices[3 * bestTriangle];
+            optimized.insert(optimized.end(), corners, corners + 3);
+            emitted[bestTriangle] = true;
+
+            // the corners go to the front of the cache, the other vertices move back (and maybe out)
+            nextCache.assign(corners, corners + 3);
+            for (GLuint v : cache) {
+                if (v != corners[0] && v != corners[1] && v != corners[2]) {
+                    nextCache.push_back(v);
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                GLuint v = corners[k];
+                int * begin = &vertexTriangles[triangleOffsets[v]];
+                int * last = begin + remainingTriangles[v] - 1;
+                std::iter_swap(std::find(begin, last + 1, bestTriangle), last);
+                remainingTriangles[v]--;
+            }
+
+            // rescore the vertices whose cache position changed, and their triangles; the best one is the next candidate
+            for (size_t i = 0; i < nextCache.size(); i++) {
+                GLuint v = nextCache[i];
+                cachePositions[v] = (i < cacheSize) ? (int)i : -1;
+                float score = vertexScore(cachePositions[v], remainingTriangles[v]);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                for (int j = triangleOffsets[v]; j < triangleOffsets[v] + remainingTriangles[v]; j++) {
+                    triangleScores[vertexTriangles[j]] += delta;
+                }
+            }
+            nextCache.resize(std::min<size_t>(nextCache.size(), cacheSize));
+            std::swap(cache, nextCache);
+            bestTriangle = -1;
+            float bestScore = -1.0f;
+            for (GLuint v : cache) {
+                for (int j = triangleOffsets[v]; j < triangleOffsets[v] + remainingTriangles[v]; j++) {
+                    int t = vertexTriangles[j];
+                    if (triangleScores[t] > bestScore) {
+                        bestScore = triangleScores[t];
+                        bestTriangle = t;
+                    }
+                }
+            }
+        }
+        return optimized;
+    }
+
+    // renumber the vertices in the order of their first use, rewriting 'indices'; the unused vertices go last
+    // returns the new position of every vertex, for remapVertices()
+    static std::vector<GLuint> optimizeVertexFetch(std::vector<GLuint> & indices, int vertexCount) {
+        const GLuint unused = ~0u;
+        std::vector<GLuint> remap(vertexCount, unused);
+        GLuint next = 0;
+        for (GLuint & index : indices) {
+            if (remap[index] == unused) {
+                remap[index] = next++;
+            }
+            index = remap[index];
+        }
+        for (GLuint & position : remap) {
+            if (position == unused) {
+                position = next++;
+            }
+        }
+        return remap;
+    }
+
+    // move every vertex attribute to its new position
+    template <typename T>
+    static void remapVertices(std::vector<T> & attribute, const std::vector<GLuint> & remap) {
+        if (attribute.empty()) {
+            return;
+        }
+        std::vector<T> remapped(attribute.size());
+        for (size_t v = 0; v < attribute.size(); v++) {
+            remapped[remap[v]] = attribute[v];
+        }
+        attribute.swap(remapped);
+    }
+
+    static VertexCacheStats analyzeVertexCache(const std::vector<GLuint> & indices, int vertexCount) {
+        VertexCacheStats stats;
+        if (indices.empty() || vertexCount == 0) {
+            return stats;
+        }
+        // FIFO: a vertex is in the cache if it was transformed less than cacheSize misses ago
+        std::vector<int> transformedAt(vertexCount, -simulatedCacheSize - 1);
+        int misses = 0;
+        for (GLuint index : indices) {
+            if (misses - transformedAt[index] > simulatedCacheSize) {
+                transformedAt[index] = misses;
+                misses++;
+            }
+        }
+        stats.ACMR = (float)misses / (indices.size() / 3);
+        stats.ATVR = (float)misses / vertexCount;
+        return stats;
+    }
+
+private:
+    static const int cacheSize = 32; // the cache modelled by the scores, larger than the real one so it also works well there
+
+    // Forsyth's scoring: the last triangle's vertices get a fixed score (they are equally recent), the older ones decay
+    // with their position, and the vertices with few triangles left get a boost
+    static float vertexScore(int cachePosition, int remainingTriangles) {
+        if (remainingTriangles == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                score = 0.75f;
+            }
+            else {
+                score = std::pow(1.0f - (float)(cachePosition - 3) / (cacheSize - 3), 1.5f);
+            }
+        }
+        return score + 2.0f / std::sqrt((float)remainingTriangles);
+    }
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+// a mesh sub-allocated in the pool, in vertices and indices
+struct MeshRange {
+    GLint baseVertex = 0;
+    GLint vertexCount = 0;
+    GLuint firstIndex = 0;
+    GLsizei indexCount = 0;
+    bool ownsVertices = true; // false for the levels of detail, they index the vertices of their base mesh
+};
+
+// the vertices and indices of the static meshes, sub-allocated in one large vertex buffer and one large index buffer
+// every mesh in the pool is drawn with the same VAO (glDrawElementsBaseVertex with the range of the mesh), so the
+// render queue can submit them together with glMultiDrawElementsIndirect without switching any geometry state
+// vertex format: position (location 0), normal (1), uv (2), 8 floats per vertex; attribute 3 is the per-draw object index,
+// read with divisor 1 from the draw records of the IndirectDrawList (the draws select their record with their base instance)
+class MeshPool
+{
+public:
+    static const int floatsPerVertex = 8;
+
+    static MeshPool & get()
+    {
+        static MeshPool pool;
+        return pool;
+    }
+
+    // copy a mesh into the pool, returns its handle
+    int add(const std::vector<GLfloat> & vertices, const std::vector<GLuint> & indices)
+    {
+        if (VAO == 0) {
+            createBuffers();
+        }
+        MeshRange range;
+        range.vertexCount = vertices.size() / floatsPerVertex;
+        range.indexCount = indices.size();
+        range.baseVertex = allocate(vertexBlocks, vertexCapacity, range.vertexCount, VBO, floatsPerVertex * sizeof(GLfloat));
+        range.firstIndex = allocate(indexBlocks, indexCapacity, range.indexCount, EBO, sizeof(GLuint));
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, range.baseVertex * floatsPerVertex * sizeof(GLfloat), vertices.size() * sizeof(GLfloat), vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, EBO);
+        glBufferSubData(GL_ARRAY_BUFFER, range.firstIndex * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return store(range);
+    }
+
+    // copy other indices of the vertices of 'baseMesh' into the pool (a level of detail), returns the handle of the new mesh
+    // it has to be released before its base mesh
+    int addIndices(int baseMesh, const std::vector<GLuint> & indices)
+    {
+        MeshRange range;
+        range.baseVertex = meshes[baseMesh].baseVertex;
+        range.vertexCount = meshes[baseMesh].vertexCount;
+        range.indexCount = indices.size();
+        range.ownsVertices = false;
+        range.firstIndex = allocate(indexBlocks, indexCapacity, range.indexCount, EBO, sizeof(GLuint));
+        glBindBuffer(GL_ARRAY_BUFFER, EBO);
+        glBufferSubData(GL_ARRAY_BUFFER, range.firstIndex * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return store(range);
+    }
+
+    // give the ranges of the mesh back to the pool, the handle becomes invalid
+    void release(int mesh)
+    {
+        if (mesh < 0 || mesh >= (int)meshes.size() || meshes[mesh].vertexCount == 0) {
+            std::cout << "[MeshPool]: error: releasing unknown mesh " << mesh << std::endl;
+            return;
+        }
+        if (meshes[mesh].ownsVertices) {
+            freeRange(vertexBlocks, meshes[mesh].baseVertex, meshes[mesh].vertexCount);
+        }
+        freeRange(indexBlocks, meshes[mesh].firstIndex, meshes[mesh].indexCount);
+        meshes[mesh] = MeshRange();
+        freeMeshes.push_back(mesh);
+    }
+
+    const MeshRange & getRange(int mesh) const { return meshes[mesh]; }
+    GLuint getVertexArray() const { return VAO; }
+
+    // source of the per-draw object index (attribute 3): one record of 'stride' bytes per draw, the index at 'offset'
+    void setDrawRecordBuffer(GLuint buffer, GLsizei stride, GLsizei offset)
+    {
+        if (VAO == 0) {
+            createBuffers();
+        }
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribIPointer(3, 1, GL_INT, stride, (void*)(size_t)offset);
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(3);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // draw one mesh of the pool, with the current program
+    void draw(int mesh) const
+    {
+        const MeshRange & range = meshes[mesh];
+        glBindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+        glBindVertexArray(0);
+    }
+
+    int getMeshCount() const { return meshes.size() - freeMeshes.size(); }
+
+    void printStats() const
+    {
+        std::cout << "[MeshPool]: " << getMeshCount() << " meshes in " << vertexCapacity << " vertices and " << indexCapacity << " indices" << std::endl;
+    }
+
+private:
+    // a free range of a buffer, in elements
+    struct Block {
+        GLint first;
+        GLint count;
+    };
+
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    GLuint EBO = 0;
+    GLint vertexCapacity = 0; // in vertices
+    GLint indexCapacity = 0; // in indices
+    std::vector<Block> vertexBlocks; // free ranges, sorted by their first element
+    std::vector<Block> indexBlocks;
+    std::vector<MeshRange> meshes;
+    std::vector<int> freeMeshes; // released handles, reused by the next add()
+
+    MeshPool() {}
+
+    // a handle for the range, reusing a released one if there is any
+    int store(const MeshRange & range)
+    {
+        int mesh;
+        if (!freeMeshes.empty()) {
+            mesh = freeMeshes.back();
+            freeMeshes.pop_back();
+            meshes[mesh] = range;
+        }
+        else {
+            mesh = meshes.size();
+            meshes.push_back(range);
+        }
+        return mesh;
+    }
+
+    void createBuffers()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        bindVertexFormat();
+    }
+
+    void bindVertexFormat()
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), (void*)0); // position
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), (void*)(3 * sizeof(float))); // normal
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, floatsPerVertex * sizeof(float), (void*)(6 * sizeof(float))); // uv
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // first fit in the free ranges; without room the buffer grows (at least doubles) and keeps its content
+    GLint allocate(std::vector<Block> & blocks, GLint & capacity, GLint count, GLuint & buffer, GLsizei elementSize)
+    {
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (blocks[i].count >= count) {
+                GLint first = blocks[i].first;
+                blocks[i].first += count;
+                blocks[i].count -= count;
+                if (blocks[i].count == 0) {
+                    blocks.erase(blocks.begin() + i);
+                }
+                return first;
+            }
+        }
+        GLint oldCapacity = capacity;
+        capacity = std::max(std::max(2 * capacity, capacity + count), 1 << 16);
+        grow(buffer, oldCapacity * elementSize, capacity * elementSize);
+        freeRange(blocks, oldCapacity, capacity - oldCapacity);
+        return allocate(blocks, capacity, count, buffer, elementSize);
+    }
+
+    // reallocate a buffer, copying its content on the GPU, and point the VAO to the new one
+    void grow(GLuint & buffer, GLsizeiptr oldSize, GLsizeiptr newSize)
+    {
+        GLuint newBuffer;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+        if (oldSize > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = newBuffer;
+        bindVertexFormat();
+    }
+
+    // return a range to the free list, merged with its neighbors
+    static void freeRange(std::vector<Block> & blocks, GLint first, GLint count)
+    {
+        if (count == 0) {
+            return;
+        }
+        auto it = std::lower_bound(blocks.begin(), blocks.end(), first, [](const Block & block, GLint value) { return block.first < value; });
+        it = blocks.insert(it, {first, count});
+        if (it + 1 != blocks.end() && it->first + it->count == (it + 1)->first) {
+            it->count += (it + 1)->count;
+            blocks.erase(it + 1);
+        }
+        if (it != blocks.begin() && (it - 1)->first + (it - 1)->count == it->first) {
+            (it - 1)->count += it->count;
+            blocks.erase(it);
+        }
+    }
+
+    MeshPool(const MeshPool&) = delete;
+    MeshPool& operator=(const MeshPool&) = delete;
+};
+
+#endif
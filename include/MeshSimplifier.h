@@ -0,0 +1,253 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+// quadric error metric simplification (Garland and Heckbert 1997: "Surface Simplification Using Quadric Error Metrics")
+// with half-edge collapses: a vertex is merged into one of its neighbors, so the simplified triangles still index the
+// original vertices and all the levels of detail of a mesh can share one vertex buffer
+// the vertices on boundary edges never move, which also keeps the uv and normal seams closed (their vertices are split)
+class MeshSimplifier {
+public:
+    // the triangles simplified down to targetTriangleCount, or less far if every remaining collapse would move the surface
+    // by more than maxError (relative to the size of the mesh)
+    static std::vector<GLuint> simplify(const std::vector<glm::vec3> & positions, const std::vector<GLuint> & indices,
+                                        size_t targetTriangleCount, float maxError) {
+        int vertexCount = positions.size();
+        int triangleCount = indices.size() / 3;
+        std::vector<GLuint> triangles = indices;
+        std::vector<bool> removedTriangles(triangleCount, false);
+        std::vector<std::vector<int>> vertexTriangles(vertexCount);
+        std::vector<Quadric> quadrics(vertexCount);
+        glm::vec3 AA = positions.empty() ? glm::vec3(0.0f) : positions[0];
+        glm::vec3 BB = AA;
+        for (const glm::vec3 & position : positions) {
+            AA = glm::min(AA, position);
+            BB = glm::max(BB, position);
+        }
+        double maxCost = (double)maxError * glm::length(BB - AA);
+        maxCost *= maxCost;
+
+        // the quadric of a vertex sums the squared distances to the planes of its triangles
+        std::unordered_map<uint64_t, int> edgeUses;
+        for (int t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                GLuint a = triangles[3 * t + k];
+                GLuint b = triangles[3 * t + (k + 1) % 3];
+                vertexTriangles[a].push_back(t);
+                edgeUses[edgeKey(a, b)]++;
+            }
+            glm::dvec3 p0 = positions[triangles[3 * t]];
+            glm::dvec3 normal = glm::cross(glm::dvec3(positions[triangles[3 * t + 1]]) - p0, glm::dvec3(positions[triangles[3 * t + 2]]) - p0);
+            double length = glm::length(normal);
+            if (length == 0.0) {
+                continue;
+            }
+            normal /= length;
+            Quadric plane(normal, -glm::dot(normal, p0));
+            for (int k = 0; k < 3; k++) {
+                quadrics[triangles[3 * t + k]] += plane;
+            }
+        }
+        // boundary (used once) and non-manifold (used more than twice) edges lock their vertices
+        std::vector<bool> locked(vertexCount, false);
+        for (const auto & edge : edgeUses) {
+            if (edge.second != 2) {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xFFFFFFFFu] = true;
+            }
+        }
+
+        // candidate collapses, cheapest first; a candidate is stale once one of its vertices changed (version)
+        std::vector<int> versions(vertexCount, 0);
+        std::vector<bool> removedVertices(vertexCount, false);
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> candidates;
+        auto addCandidates = [&](GLuint vertex) {
+            for (int t : vertexTriangles[vertex]) {
+                if (removedTriangles[t]) {
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    GLuint other = triangles[3 * t + k];
+                    if (other == vertex) {
+                        continue;
+                    }
+                    if (!locked[vertex]) {
+                        candidates.push({collapseCost(quadrics, positions, vertex, other), vertex, other, versions[vertex], versions[other]});
+                    }
+                    if (!locked[other]) {
+                        candidates.push({collapseCost(quadrics, positions, other, vertex), other, vertex, versions[other], versions[vertex]});
+                    }
+                }
+            }
+        };
+        for (int v = 0; v < vertexCount; v++) {
+            if (!locked[v]) {
+                addCandidates(v);
+            }
+        }
+
+        size_t liveTriangles = triangleCount;
+        while (liveTriangles > targetTriangleCount && !candidates.empty()) {
+            Collapse collapse = candidates.top();
+            candidates.pop();
+            if (removedVertices[collapse.from] || removedVertices[collapse.to]
+                || versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion) {
+                continue;
+            }
+            if (collapse.cost > maxCost) {
+                break;
+            }
+            if (breaksLinkCondition(triangles, removedTriangles, vertexTriangles, collapse.from, collapse.to)
+                || flipsTriangle(positions, triangles, removedTriangles, vertexTriangles[collapse.from], collapse.from, collapse.to)) {
+                continue;
+            }
+            // the triangles around the edge disappear, the others move their corner to the kept vertex
+            for (int t : vertexTriangles[collapse.from]) {
+                if (removedTriangles[t]) {
+                    continue;
+                }
+                GLuint * corners = &triangles[3 * t];
+                if (corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) {
+                    removedTriangles[t] = true;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    if (corners[k] == collapse.from) {
+                        corners[k] = collapse.to;
+                    }
+                }
+                vertexTriangles[collapse.to].push_back(t);
+            }
+            quadrics[collapse.to] += quadrics[collapse.from];
+            removedVertices[collapse.from] = true;
+            versions[collapse.to]++;
+            addCandidates(collapse.to);
+        }
+
+        std::vector<GLuint> simplified;
+        simplified.reserve(3 * liveTriangles);
+        for (int t = 0; t < triangleCount; t++) {
+            if (!removedTriangles[t]) {
+                simplified.insert(simplified.end(), triangles.begin() + 3 * t, triangles.begin() + 3 * t + 3);
+            }
+        }
+        return simplified;
+    }
+
+private:
+    // symmetric 4x4 matrix, upper triangle: xx xy xz xw yy yz yw zz zw ww
+    struct Quadric {
+        double m[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        Quadric() {}
+        // squared distance to the plane dot(normal, p) + d = 0
+        Quadric(const glm::dvec3 & n, double d) {
+            m[0] = n.x * n.x; m[1] = n.x * n.y; m[2] = n.x * n.z; m[3] = n.x * d;
+            m[4] = n.y * n.y; m[5] = n.y * n.z; m[6] = n.y * d;
+            m[7] = n.z * n.z; m[8] = n.z * d;
+            m[9] = d * d;
+        }
+        Quadric & operator+=(const Quadric & other) {
+            for (int i = 0; i < 10; i++) {
+                m[i] += other.m[i];
+            }
+            return *this;
+        }
+        double error(const glm::dvec3 & p) const {
+            return m[0] * p.x * p.x + 2.0 * m[1] * p.x * p.y + 2.0 * m[2] * p.x * p.z + 2.0 * m[3] * p.x
+                 + m[4] * p.y * p.y + 2.0 * m[5] * p.y * p.z + 2.0 * m[6] * p.y
+                 + m[7] * p.z * p.z + 2.0 * m[8] * p.z
+                 + m[9];
+        }
+    };
+
+    // merge 'from' into 'to'
+    struct Collapse {
+        double cost;
+        GLuint from;
+        GLuint to;
+        int fromVersion;
+        int toVersion;
+        bool operator>(const Collapse & other) const { return cost > other.cost; }
+    };
+
+    static uint64_t edgeKey(GLuint a, GLuint b) {
+        return ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+    }
+
+    static double collapseCost(const std::vector<Quadric> & quadrics, const std::vector<glm::vec3> & positions, GLuint from, GLuint to) {
+        Quadric sum = quadrics[from];
+        sum += quadrics[to];
+        return std::max(sum.error(glm::dvec3(positions[to])), 0.0);
+    }
+
+    // the link condition: the vertices adjacent to both ends of the edge must be the opposite corners of the triangles on
+    // the edge, another shared neighbor would pinch the surface into a non-manifold fan or fold two triangles onto each other
+    static bool breaksLinkCondition(const std::vector<GLuint> & triangles, const std::vector<bool> & removedTriangles,
+                                    const std::vector<std::vector<int>> & vertexTriangles, GLuint from, GLuint to) {
+        std::vector<GLuint> fromNeighbors, edgeOpposites;
+        for (int t : vertexTriangles[from]) {
+            if (removedTriangles[t]) {
+                continue;
+            }
+            const GLuint * corners = &triangles[3 * t];
+            bool onEdge = corners[0] == to || corners[1] == to || corners[2] == to;
+            for (int k = 0; k < 3; k++) {
+                if (corners[k] != from && corners[k] != to) {
+                    (onEdge ? edgeOpposites : fromNeighbors).push_back(corners[k]);
+                }
+            }
+        }
+        for (int t : vertexTriangles[to]) {
+            if (removedTriangles[t]) {
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                GLuint v = triangles[3 * t + k];
+                if (v == from || v == to) {
+                    continue;
+                }
+                if (std::find(fromNeighbors.begin(), fromNeighbors.end(), v) != fromNeighbors.end()
+                    && std::find(edgeOpposites.begin(), edgeOpposites.end(), v) == edgeOpposites.end()) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // whether moving 'from' onto 'to' turns one of the remaining triangles around 'from' over (or makes it degenerate)
+    static bool flipsTriangle(const std::vector<glm::vec3> & positions, const std::vector<GLuint> & triangles, const std::vector<bool> & removedTriangles,
+                              const std::vector<int> & fromTriangles, GLuint from, GLuint to) {
+        for (int t : fromTriangles) {
+            if (removedTriangles[t]) {
+                continue;
+            }
+            const GLuint * corners = &triangles[3 * t];
+            if (corners[0] == to || corners[1] == to || corners[2] == to) {
+                continue;
+            }
+            glm::vec3 before[3], after[3];
+            for (int k = 0; k < 3; k++) {
+                before[k] = positions[corners[k]];
+                after[k] = (corners[k] == from) ? positions[to] : before[k];
+            }
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif
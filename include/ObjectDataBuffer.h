@@ -0,0 +1,102 @@
+#ifndef OBJECT_DATA_BUFFER_H
+#define OBJECT_DATA_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+// per-object data of the rasterized objects: std430 layout of ObjectData in shaders/object_common.glsl
+struct ObjectData {
+    glm::mat4 model;
+    glm::mat4 normalMatrix; // transpose(inverse(model)), only the upper 3x3 is used
+    glm::vec4 color; // the base color of the object, it also contains the opacity
+    GLint materialType = 0; // 0: lambertian, 1: metal, 2: dielectric, 3: emissive(light source), -1: unknown
+    GLfloat refractionRatio = 0.3f;
+    GLfloat averageSlope = 0.5f;
+    GLint useTexture = 0;
+};
+
+// the records of all rasterized objects, in one shader storage buffer
+// an object owns a slot and rewrites its record when it changes; the records written since the last upload are sent
+// in one glBufferSubData before the render queue is drawn, and a draw only selects its record with the 'objectIndex' uniform
+// (the batched draws of the render queue select the records of their objects with a per-draw vertex attribute, see IndirectDrawList)
+class ObjectDataBuffer
+{
+public:
+    static const GLuint binding = 2; // shader storage buffer binding of the ObjectDataBuffer block
+
+    static ObjectDataBuffer & get()
+    {
+        static ObjectDataBuffer objectDataBuffer;
+        return objectDataBuffer;
+    }
+
+    // a new slot, its record is undefined until written
+    int allocate()
+    {
+        if (!freeSlots.empty()) {
+            int index = freeSlots.back();
+            freeSlots.pop_back();
+            return index;
+        }
+        records.emplace_back();
+        return records.size() - 1;
+    }
+
+    void release(int index)
+    {
+        freeSlots.push_back(index);
+    }
+
+    void write(int index, const ObjectData & data)
+    {
+        records[index] = data;
+        dirtyBegin = std::min(dirtyBegin, index);
+        dirtyEnd = std::max(dirtyEnd, index + 1);
+    }
+
+    // send the records written since the last upload, and bind the buffer
+    void upload()
+    {
+        if (buffer == 0) {
+            glGenBuffers(1, &buffer);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        if (capacity < (int)records.size()) {
+            // grow geometrically, everything is sent again
+            capacity = std::max(64, 2 * (int)records.size());
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(ObjectData), nullptr, GL_DYNAMIC_DRAW);
+            dirtyBegin = 0;
+            dirtyEnd = records.size();
+        }
+        if (dirtyBegin < dirtyEnd) {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, dirtyBegin * sizeof(ObjectData), (dirtyEnd - dirtyBegin) * sizeof(ObjectData), &records[dirtyBegin]);
+            dirtyBegin = std::numeric_limits<int>::max();
+            dirtyEnd = 0;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+    }
+
+    int getObjectCount() const { return records.size() - freeSlots.size(); }
+    // every index given out so far is below it
+    int getSlotCount() const { return records.size(); }
+
+private:
+    std::vector<ObjectData> records;
+    std::vector<int> freeSlots;
+    GLuint buffer = 0;
+    int capacity = 0; // in records
+    int dirtyBegin = std::numeric_limits<int>::max(); // range of records written since the last upload
+    int dirtyEnd = 0;
+
+    ObjectDataBuffer() {}
+
+    ObjectDataBuffer(const ObjectDataBuffer&) = delete;
+    ObjectDataBuffer& operator=(const ObjectDataBuffer&) = delete;
+};
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <Shader.h>
+#include <GPUProfiler.h>
+#include <IndirectDrawList.h>
+
+#include <algorithm>
+#include <iostream>
+
+// two-phase hierarchical-Z occlusion culling of the batched draws of the render queue, all on the GPU:
+// phase 1 draws the objects that were visible in the last frame (the command pass of the IndirectDrawList reads the
+// visibility buffer), then the depth buffer is resolved and reduced into a Hi-Z pyramid, the bounds of every draw record
+// (the world space boxes of the TLAS leaves) are tested against it, and phase 2 draws the objects that became visible;
+// the test results are the visible set of the next frame
+class OcclusionCuller {
+public:
+    static const GLuint visibilityBinding = 5; // shader storage buffer binding of the VisibilityBuffer block
+
+    OcclusionCuller() {
+        hiZShader = new ComputeShader("shaders/hiz_build.comp");
+        testShader = new ComputeShader("shaders/occlusion_test.comp");
+        glGenBuffers(1, &visibilityBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenFramebuffers(1, &resolveFramebuffer);
+    }
+    ~OcclusionCuller() {
+        releaseTextures();
+        glDeleteBuffers(1, &visibilityBuffer);
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteFramebuffers(1, &resolveFramebuffer);
+        delete hiZShader;
+        delete testShader;
+    }
+
+    // make room for the objects [0, objectCount) and bind the visibility buffer for the first phase
+    // an object seen for the first time counts as visible, so it is an occluder from its first frame on
+    void bindVisibility(int objectCount) {
+        if (objectCount > visibilityCapacity) {
+            int newCapacity = std::max(256, 2 * objectCount);
+            GLuint newBuffer;
+            glGenBuffers(1, &newBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+            GLuint visible = 1;
+            glClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, visibilityCapacity * sizeof(GLuint), (newCapacity - visibilityCapacity) * sizeof(GLuint),
+                GL_RED_INTEGER, GL_UNSIGNED_INT, &visible);
+            if (visibilityCapacity > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, visibilityBuffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, visibilityCapacity * sizeof(GLuint));
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &visibilityBuffer);
+            visibilityBuffer = newBuffer;
+            visibilityCapacity = newCapacity;
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, visibilityBinding, visibilityBuffer);
+    }
+
+    // after the first phase: build the pyramid from the current depth buffer and write the commands of the second phase
+    void cull(const IndirectDrawList & drawList, const glm::mat4 & viewProjection, int width, int height, GPUProfiler * profiler) {
+        if (width == 0 || height == 0 || drawList.size() == 0) {
+            return;
+        }
+        GLint sceneFramebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+        reserve(width, height, drawList.size(), getDepthFormat(sceneFramebuffer));
+        {
+            GPUProfileScope scope(profiler, "Hi-Z build");
+            // the depth buffer of the scene cannot be sampled (the default framebuffer's, and it is multisampled):
+            // resolve it into a single sample texture first, a blit of the depth takes the nearest sample
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+
+            hiZShader->use();
+            hiZShader->setInt("sourceTexture", 0);
+            glActiveTexture(GL_TEXTURE0);
+            for (int level = 0; level < levelCount; level++) {
+                int levelWidth = std::max(width >> level, 1);
+                int levelHeight = std::max(height >> level, 1);
+                glBindTexture(GL_TEXTURE_2D, (level == 0) ? depthTexture : hiZTexture);
+                hiZShader->setInt("sourceLevel", level - 1);
+                hiZShader->setInt("sourceWidth", std::max(width >> std::max(level - 1, 0), 1));
+                hiZShader->setInt("sourceHeight", std::max(height >> std::max(level - 1, 0), 1));
+                glBindImageTexture(0, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+                glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+                glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            }
+            glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        }
+        {
+            GPUProfileScope scope(profiler, "Occlusion test");
+            testShader->use();
+            testShader->setInt("drawCount", drawList.size());
+            testShader->setMat4("viewProjection", viewProjection);
+            testShader->setInt("hiZTexture", 0);
+            testShader->setInt("hiZWidth", width);
+            testShader->setInt("hiZHeight", height);
+            testShader->setInt("hiZLevels", levelCount);
+            glBindTexture(GL_TEXTURE_2D, hiZTexture);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IndirectDrawList::recordBinding, drawList.getRecordBuffer());
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IndirectDrawList::commandBinding, commandBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, visibilityBinding, visibilityBuffer);
+            glDispatchCompute((drawList.size() + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+
+    // the commands of the second phase, for IndirectDrawList::drawIndirect
+    GLuint getCommandBuffer() const { return commandBuffer; }
+
+private:
+    Shader * hiZShader;
+    Shader * testShader;
+    GLuint depthTexture = 0; // single sample copy of the depth buffer, in its format (a blit cannot convert depth)
+    GLenum depthFormat = 0;
+    GLuint resolveFramebuffer = 0; // depthTexture as its depth attachment
+    GLuint hiZTexture = 0; // r32f, full mip chain
+    int textureWidth = 0;
+    int textureHeight = 0;
+    int levelCount = 0;
+    GLuint visibilityBuffer = 0;
+    int visibilityCapacity = 0; // in objects
+    GLuint commandBuffer = 0;
+    int commandCapacity = 0; // in draws
+
+    // the sized internal format of the depth buffer of 'framebuffer' (bound for reading)
+    static GLenum getDepthFormat(GLint framebuffer) {
+        GLenum depthAttachment = (framebuffer == 0) ? GL_DEPTH : GL_DEPTH_ATTACHMENT;
+        GLenum stencilAttachment = (framebuffer == 0) ? GL_STENCIL : GL_STENCIL_ATTACHMENT;
+        GLint depthBits = 0, stencilBits = 0, componentType = GL_NONE;
+        glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+        glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &componentType);
+        glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+        if (componentType == GL_FLOAT) {
+            return (stencilBits > 0) ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+        }
+        if (depthBits <= 16) {
+            return GL_DEPTH_COMPONENT16;
+        }
+        if (depthBits <= 24) {
+            return (stencilBits > 0) ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+        }
+        return GL_DEPTH_COMPONENT32;
+    }
+
+    // (re)allocate the textures at the framebuffer size and depth format, and the commands for 'drawCount' draws
+    void reserve(int width, int height, int drawCount, GLenum sourceDepthFormat) {
+        if (drawCount > commandCapacity) {
+            commandCapacity = std::max(256, 2 * drawCount);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        if (width == textureWidth && height == textureHeight && sourceDepthFormat == depthFormat) {
+            return;
+        }
+        releaseTextures();
+        levelCount = 1;
+        while ((std::max(width, height) >> levelCount) > 0) {
+            levelCount++;
+        }
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, sourceDepthFormat, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        GLint previousFramebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        bool hasStencil = sourceDepthFormat == GL_DEPTH24_STENCIL8 || sourceDepthFormat == GL_DEPTH32F_STENCIL8;
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, hasStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "[OcclusionCuller]: error: the depth resolve framebuffer is incomplete" << std::endl;
+        }
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebuffer);
+        glGenTextures(1, &hiZTexture);
+        glBindTexture(GL_TEXTURE_2D, hiZTexture);
+        glTexStorage2D(GL_TEXTURE_2D, levelCount, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        textureWidth = width;
+        textureHeight = height;
+        depthFormat = sourceDepthFormat;
+    }
+
+    void releaseTextures() {
+        if (depthTexture != 0) {
+            glDeleteTextures(1, &depthTexture);
+            glDeleteTextures(1, &hiZTexture);
+            depthTexture = 0;
+            hiZTexture = 0;
+        }
+    }
+
+    // not copyable
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+};
+
+#endif
@@ -17,14 +17,14 @@ public:
     void rotateCamera(double xposIn, double yposIn) override {
         CameraController::rotateCamera(xposIn, yposIn);
         if (enableCameraControl) {
-            GPURT_manager->resetFrameCounter();
+            GPURT_manager->notifyCameraMoved();
         }
     }
 
     void adjustfov(float yoffset) override {
         CameraController::adjustfov(yoffset);
         if (enableCameraControl) {
-            GPURT_manager->resetFrameCounter();
+            GPURT_manager->notifyCameraMoved();
         }
     }
 
@@ -75,7 +75,7 @@ void keyboardActions(RTRTStateMachine * state_machine,RayTraceCameraController *
             }
             if (camera_moved) {
                 if(GPURT_manager != nullptr) {
-                    GPURT_manager->resetFrameCounter();
+                    GPURT_manager->notifyCameraMoved();
                 }
             }
         }
@@ -2,6 +2,7 @@
 #define RAYTRACEOBJECT_H
 
 #include "GraphicObject.h"
+#include "ShaderRegistry.h"
 #include "SceneObject.h"
 #include <GPU_RAYTRACER/GPU_RAYTRACER.h>
 #include <CPU_RAYTRACER/CPU_RAYTRACER.h>
@@ -27,10 +28,33 @@ public:
         }
         obj->draw();
     }
+    const Shader * getProgram() const override {
+        return obj->shader;
+    }
+    GMVPObject * getDrawObject() const override {
+        return obj;
+    }
+    // the object space AABB of the object, the world space one follows its model matrix
+    void setLocalBounds(const glm::vec3 & AA, const glm::vec3 & BB) {
+        localAA = AA;
+        localBB = BB;
+        hasBounds = true;
+    }
+    bool getWorldBounds(glm::vec3 & AA, glm::vec3 & BB) const override {
+        if (!hasBounds) {
+            return false;
+        }
+        std::pair<glm::vec3, glm::vec3> bounds = GPU_RAYTRACER::transformAABB2WorldSpace(localAA, localBB, obj->model);
+        AA = bounds.first;
+        BB = bounds.second;
+        return true;
+    }
 
 private:
     GMVPObject * obj;
     RenderContext * context = nullptr;
+    bool hasBounds = false;
+    glm::vec3 localAA, localBB;
 };
 
 
@@ -52,19 +76,52 @@ public:
         encodePrimitive();
         constructLocalBLAS();
         this->renderComponent = std::make_shared<ObjectRenderComponent>(obj,_renderPriority,_context);
-        
+        updateRenderBounds();
+    }
+    // a ray tracing only object made of already encoded primitives, e.g. the static geometry of a scene merged by the raytrace_manager
+    // every primitive must carry its own material index (primitiveInfo.y), it has no default object and is never rendered by the rasterizer
+    RayTraceObject(const std::vector<GPU_RAYTRACER::Primitive> & primitives) {
+        material.type = LAMBERTIAN;
+        material.fuzzOrIOR = 0.0f;
+        material.textureID = -1;
+        material.baseColor = glm::vec3(1.0f);
+        setEncodedPrimitives(primitives);
     }
     ~RayTraceObject() {
     }
 
     void setModelMatrix(glm::mat4 modelMatrix) {
-        obj->setModel(modelMatrix);
+        // a ray tracing only object (e.g. a static batch, in world space) has no rasterized object to move
+        if (obj != nullptr) {
+            obj->setModel(modelMatrix);
+        }
         this->modelMatrix = modelMatrix;
+        transformDirty = true; // the GPU ray tracer refits this object's TLAS leaf on its next updateTLAS()
         if (CPU_object_transform != nullptr) {
             CPU_object_transform->update_model_matrix(modelMatrix);
         }
     }
 
+    // replace the primitives of a ray tracing only object and rebuild its BLAS
+    void setEncodedPrimitives(const std::vector<GPU_RAYTRACER::Primitive> & primitives) {
+        localEncodedPrimitives = primitives;
+        localBLAS.clear();
+        buildBLASBVH(0, localEncodedPrimitives.size()-1);
+        AA = localBLAS[0].AA;
+        BB = localBLAS[0].BB;
+    }
+
+    bool isTransformDirty() const { return transformDirty; }
+    // static objects never move, the GPU ray tracer may merge them in world space into a shared BLAS
+    void setStatic(bool _isStatic) { isStatic = _isStatic; }
+    bool getStatic() const { return isStatic; }
+    void clearTransformDirty() { transformDirty = false; }
+
+    // the world space bounds of the rasterized object, false if it is not rasterized (ray tracing only, or inactive)
+    bool getRenderBounds(glm::vec3 & worldAA, glm::vec3 & worldBB) const {
+        return renderComponent != nullptr && renderComponent->active && renderComponent->getWorldBounds(worldAA, worldBB);
+    }
+
     glm::mat4 getModelMatrix() {
         return modelMatrix;
     }
@@ -82,41 +139,28 @@ public:
         material.textureID = (texture == nullptr) ? -1 : 0; // -1 if no texture, 0 will later be changed to the texture ID in the texture array in raytrace_manager
         material.baseColor = glm::vec3(baseColor);
         obj->setColor(baseColor);
-        // we specify the corresponding shader in default renderer to make it easy to manage the mapping between raytracing material type and rasterization shading shader 
-        const char * vertexShaderPath = "shaders/object_shader.vert";
-        const char * fragmentShaderPath = "shaders/object_shader.frag";
         if (_texture != nullptr) {
             obj->setTexture(_texture);
             this->texture = _texture;
-            // resize the texture to 1024x1024x3
-            texture->resizeTexture(1024, 1024,3);
-        }
-        if (type == 0) {
-            obj->setShader(new Shader(vertexShaderPath, fragmentShaderPath));
+            // the texture keeps its own size, the ray tracer stores it in the texture page of its size class
         }
-        else if (type == 1) {
-            obj->setShader(new Shader(vertexShaderPath, fragmentShaderPath));
-            // hard-coded metal material uniforms
-            obj->shader->use();
-            obj->shader->setFloat("averageSlope", std::min(std::max(material.fuzzOrIOR, 0.0f), 1.0f));
-            obj->shader->setFloat("refractionRatio", 0.0f);
+        // we specify the corresponding shader in default renderer to make it easy to manage the mapping between raytracing material type and rasterization shading shader 
+        // all the material types share one program from the registry, the material parameters are stored in the object's material buffer
+        obj->setShader(ShaderRegistry::get().getShader("shaders/object_shader.vert", "shaders/object_shader.frag"));
+        if (type == 1) {
+            // hard-coded metal material parameters
+            obj->setMaterialParameters(type, 0.0f, std::min(std::max(material.fuzzOrIOR, 0.0f), 1.0f));
         }
         else if (type == 2) {
-            obj->setShader(new Shader(vertexShaderPath, fragmentShaderPath));
-            obj->shader->use();
-            obj->shader->setFloat("refractionRatio", material.fuzzOrIOR);
-            obj->shader->setFloat("averageSlope", 0.0f);
+            obj->setMaterialParameters(type, material.fuzzOrIOR, 0.0f);
         }
-        else if (type == 3) {
-            obj->setShader(new Shader(vertexShaderPath, fragmentShaderPath));
-        }
-        else{
-            // unsupported material type, use lambertian with red color
-            std::cout<<"unsupported material type"<<std::endl;
-            obj->setShader(new Shader(vertexShaderPath, fragmentShaderPath));
+        else {
+            if (type != 0 && type != 3) {
+                // unsupported material type, the shader shows it in red
+                std::cout<<"unsupported material type"<<std::endl;
+            }
+            obj->setMaterialParameters(type, 0.3f, 0.5f);
         }
-        obj->shader->use();
-        obj->shader->setInt("MaterialType", type);
 
     }
    
@@ -124,6 +168,7 @@ public:
         // GPU ray tracing components
         encodePrimitive();
         constructLocalBLAS();
+        updateRenderBounds();
         // CPU ray tracing components
         constructCPU_object();
     }
@@ -155,6 +200,16 @@ public:
 
 
     private:
+    bool transformDirty = false; // set when the model matrix changed since the last TLAS update
+    bool isStatic = false;
+
+    // the rasterizer culls with the same bounds as the TLAS leaf of the object
+    void updateRenderBounds() {
+        if (renderComponent == nullptr) {
+            return; // ray tracing only
+        }
+        std::static_pointer_cast<ObjectRenderComponent>(renderComponent)->setLocalBounds(AA, BB);
+    }
 
     void constructCPU_object(){
         CPU_object = nullptr;
@@ -232,7 +287,7 @@ public:
             GTriangle * triangle = dynamic_cast<GTriangle*>(obj);
             // encode the triangle to the primitive struct
             GPU_RAYTRACER::Primitive primitive;
-            primitive.primitiveInfo = glm::vec3(0, 0, 0); // x: primitive type(0: triangle, 1: sphere), yz: reserved
+            primitive.primitiveInfo = glm::vec3(0, -1, 0); // x: primitive type(0: triangle, 1: sphere), y: material index (-1: the object's material), z: reserved
             primitive.v0 = triangle->v0;
             primitive.v1 = triangle->v1;
             primitive.v2 = triangle->v2;
@@ -249,7 +304,7 @@ public:
             GSphere * sphere = dynamic_cast<GSphere*>(obj);
             // encode the sphere to the primitive struct
             GPU_RAYTRACER::Primitive primitive;
-            primitive.primitiveInfo = glm::vec3(1, 0, 0); // x: primitive type(0: triangle, 1: sphere), yz: reserved
+            primitive.primitiveInfo = glm::vec3(1, -1, 0); // x: primitive type(0: triangle, 1: sphere), y: material index (-1: the object's material), z: reserved
             primitive.v0 = sphere->center; // center of the sphere
             primitive.v1 = glm::vec3(sphere->radius, 0, 0); // v1.x is the radius of the sphere
             primitive.v2 = glm::vec3(0,0,0);
@@ -270,7 +325,7 @@ public:
                 for (unsigned int i = 0; i < mesh->indices.size()-2; i+=3){
                     // encode the triangle to the primitive struct
                     GPU_RAYTRACER::Primitive primitive;
-                    primitive.primitiveInfo = glm::vec3(0, 0, 0);
+                    primitive.primitiveInfo = glm::vec3(0, -1, 0);
                     primitive.v0 = mesh->positions[mesh->indices[i]];
                     primitive.v1 = mesh->positions[mesh->indices[i+1]];
                     primitive.v2 = mesh->positions[mesh->indices[i+2]];
@@ -324,7 +379,7 @@ public:
             GPU_RAYTRACER::BLASNode node;
             node.left = -1;
             node.right = -1;
-            node.n = 1;
+            node.n = -1; // negative count: a sphere leaf
             node.index = 0; // the true index will be set when the TLAS is constructed in raytrace_manager
             node.AA = glm::vec4(AA, 0);
             node.BB = glm::vec4(BB, 0);
@@ -351,141 +406,9 @@ public:
     
     // since the BLAS is relatively static in the scene, we can build it with a slower algorithm
     // but the resulting BVH should be more efficient in the ray tracing process
-    // here we use SAH to build the BVH
+    // here we use SAH to build the BVH (shared with the static batches built by the raytrace_manager)
     int buildBLASBVH(int left, int right, int maxTrianglesPerNode = 7) {
-        using GPU_RAYTRACER::BLASNode;
-        if (left > right) {
-            std::cout<<"[buildBLASBVH]: error: left > right"<<std::endl;
-            return -1;
-        }
-        BLASNode node;
-        localBLAS.push_back(BLASNode());
-        int idx = localBLAS.size()-1;
-        if (right - left + 1 <= maxTrianglesPerNode) {
-            // leaf node
-            node.left = -1;
-            node.right = -1;
-            node.n = right - left + 1; // number of triangles in the node
-            node.index = left; // point to the first triangle in the localEncodedPrimitives
-            // calculate the AABB of the leaf node's trianglesq
-            glm::vec3 AA = localEncodedPrimitives[left].v0;
-            glm::vec3 BB = localEncodedPrimitives[left].v0;
-            for (int i = left; i <= right; i++) {
-                glm::vec3 v0 = localEncodedPrimitives[i].v0;
-                glm::vec3 v1 = localEncodedPrimitives[i].v1;
-                glm::vec3 v2 = localEncodedPrimitives[i].v2;
-                AA = glm::min(AA, glm::min(v0, glm::min(v1, v2)));
-                BB = glm::max(BB, glm::max(v0, glm::max(v1, v2)));
-            }
-            node.AA = glm::vec4(AA, 0);
-            node.BB = glm::vec4(BB, 0);
-            localBLAS[idx] = node;
-            return idx;
-        }
-        // find the longest axis of the AABB
-        else{
-            // we now need to find the best split
-            int bestAxis = 0;
-            float bestCost = INFINITY;
-            int bestSplit = (left+right)/2;
-            for (int axis = 0; axis < 3; axis++) {
-                // sort the triangles along the axis
-                std::sort(localEncodedPrimitives.begin()+left, localEncodedPrimitives.begin()+right+1, [axis](const GPU_RAYTRACER::Primitive & a, const GPU_RAYTRACER::Primitive & b){
-                    glm::vec3 centerA = 0.5f * (a.v0 + a.v1 + a.v2);
-                    glm::vec3 centerB = 0.5f * (b.v0 + b.v1 + b.v2);
-                    return centerA[axis] < centerB[axis];
-                });
-
-                // leftAAs[i] is the AA(min of xyz) of the triangles from left to i
-                std::vector<glm::vec3> leftAAs(right-left+1, glm::vec3(INFINITY));
-                std::vector<glm::vec3> leftBBs(right-left+1, glm::vec3(-INFINITY));
-                
-                for (int i = left; i <= right; i++) {
-                    glm::vec3 v0 = localEncodedPrimitives[i].v0;
-                    glm::vec3 v1 = localEncodedPrimitives[i].v1;
-                    glm::vec3 v2 = localEncodedPrimitives[i].v2;
-
-                    int bias = (i == left) ? 0 : 1;
-
-                    leftAAs[i-left] = glm::min(leftAAs[i-left-bias], glm::min(v0, glm::min(v1, v2)));
-                    leftBBs[i-left] = glm::max(leftBBs[i-left-bias], glm::max(v0, glm::max(v1, v2)));
-
-                }
-
-                // rightAAs[i] is the AA(min of xyz) of the triangles from i to right
-                std::vector<glm::vec3> rightAAs(right-left+1, glm::vec3(INFINITY));
-                std::vector<glm::vec3> rightBBs(right-left+1, glm::vec3(-INFINITY));
-
-                for (int i = right; i >= left; i--) {
-                    glm::vec3 v0 = localEncodedPrimitives[i].v0;
-                    glm::vec3 v1 = localEncodedPrimitives[i].v1;
-                    glm::vec3 v2 = localEncodedPrimitives[i].v2;
-
-                    int bias = (i == right) ? 0 : 1;
-
-                    rightAAs[i-left] = glm::min(rightAAs[i-left+bias], glm::min(v0, glm::min(v1, v2)));
-                    rightBBs[i-left] = glm::max(rightBBs[i-left+bias], glm::max(v0, glm::max(v1, v2)));
-
-                }
-
-                // recursively calculate the cost of each split
-                float cost = INFINITY;
-                int split = left;
-                for (int i = left; i < right; i++) {
-                    glm::vec3 leftAA = leftAAs[i-left];
-                    glm::vec3 leftBB = leftBBs[i-left];
-                    glm::vec3 rightAA = rightAAs[i-left+1];
-                    glm::vec3 rightBB = rightBBs[i-left+1];
-                    glm::vec3 leftLength = leftBB - leftAA;
-                    float leftArea = 2.0 * (leftLength.x * leftLength.y + leftLength.y * leftLength.z + leftLength.z * leftLength.x);
-                    float leftCost = leftArea * (i - left + 1);
-                    glm::vec3 rightLength = rightBB - rightAA;
-                    float rightArea = 2.0 * (rightLength.x * rightLength.y + rightLength.y * rightLength.z + rightLength.z * rightLength.x);
-                    float rightCost = rightArea * (right - i);
-                    float splitCost = leftCost + rightCost;
-                    if (splitCost < cost) {
-                        cost = splitCost;
-                        split = i;
-                    }
-                }
-                if (cost < bestCost) {
-                    bestCost = cost;
-                    bestAxis = axis;
-                    bestSplit = split;
-                }
-            }
-            // sort the triangles along the best axis
-            std::sort(localEncodedPrimitives.begin()+left, localEncodedPrimitives.begin()+right+1, [bestAxis](const GPU_RAYTRACER::Primitive & a, const GPU_RAYTRACER::Primitive & b){
-                glm::vec3 centerA = 0.5f * (a.v0 + a.v1 + a.v2);
-                glm::vec3 centerB = 0.5f * (b.v0 + b.v1 + b.v2);
-                return centerA[bestAxis] < centerB[bestAxis];
-            });
-            // recursively build the left and right child
-            int leftChild = buildBLASBVH(left, bestSplit, maxTrianglesPerNode);
-            int rightChild = buildBLASBVH(bestSplit+1, right, maxTrianglesPerNode);
-            node.left = leftChild;
-            node.right = rightChild;
-            node.n = 0; // not a leaf node
-            node.index = -1; // not a leaf node
-            // calculate the AABB of the node
-            glm::vec3 AA = glm::vec3(FLT_MAX);
-            glm::vec3 BB = glm::vec3(-FLT_MAX);
-            if (leftChild != -1) {
-                AA = glm::min(AA, glm::vec3(localBLAS[leftChild].AA));
-                BB = glm::max(BB, glm::vec3(localBLAS[leftChild].BB));
-            }
-            if (rightChild != -1) {
-                AA = glm::min(AA, glm::vec3(localBLAS[rightChild].AA));
-                BB = glm::max(BB, glm::vec3(localBLAS[rightChild].BB));
-            }
-            if (leftChild == -1 && rightChild == -1) {
-                std::cout<<"[buildBLASBVH]: error: both left and right child are -1"<<std::endl;
-            }
-            node.AA = glm::vec4(AA, 0);
-            node.BB = glm::vec4(BB, 0);
-            localBLAS[idx] = node;
-            return idx;
-        }
+        return GPU_RAYTRACER::buildBLASBVH(localEncodedPrimitives, localBLAS, left, right, maxTrianglesPerNode);
     }
 
     // just use random axis for this one
@@ -595,75 +518,4 @@ RayTraceSkybox(GSkybox * _skybox) {
 };
 
 
-class ObjectRotationComponent : public IComponent {
-public:
-    ObjectRotationComponent(float _rotationSpeed = 3.0f) {
-        this->rotationSpeed = _rotationSpeed;
-    }
-    void Tick(float deltaTime) override {
-        // cast to RayTraceObject
-        if (owner == nullptr) {
-            std::cout<<"[ObjectRotationComponent]: owner is nullptr"<<std::endl;
-            return;
-        }
-        if (dynamic_cast<RayTraceObject*>(owner)) {
-            RayTraceObject * rayTraceObject = dynamic_cast<RayTraceObject*>(owner);
-            rayTraceObject->setModelMatrix(glm::rotate(rayTraceObject->getModelMatrix(), glm::radians(rotationSpeed) * deltaTime, glm::vec3(0, 1, 0)));
-        }
-
-    }
-private:
-    float rotationSpeed = 3.0f;
-};
-
-class ObjectPeriodicTranslationComponent : public IComponent {
-public:
-    ObjectPeriodicTranslationComponent(glm::vec3 _translationSpeed = glm::vec3(0, 0, 0), glm::vec3 _translationRange = glm::vec3(0, 0, 0)) {
-        this->translationSpeed = _translationSpeed;
-        this->translationRange = _translationRange;
-        this->currentTranslation = glm::vec3(0, 0, 0);
-    }
-    void Tick(float deltaTime) override {
-        // cast to RayTraceObject
-        if (owner == nullptr) {
-            std::cout<<"[ObjectRotationComponent]: owner is nullptr"<<std::endl;
-            return;
-        }
-        if (dynamic_cast<RayTraceObject*>(owner)) {
-            RayTraceObject * rayTraceObject = dynamic_cast<RayTraceObject*>(owner);
-            
-            glm::vec3 scale = glm::vec3(rayTraceObject->getModelMatrix()[0][0], rayTraceObject->getModelMatrix()[1][1], rayTraceObject->getModelMatrix()[2][2]);
-            glm::vec3 translation = translationSpeed * deltaTime;
-            translation = translation / scale; // adjust the translation by the scale of the object
-            if (glm::length(currentTranslation + translation) > glm::length(translationRange / scale)) {
-                translation = -translation;
-                translationSpeed = -translationSpeed;
-            }
-            rayTraceObject->setModelMatrix(glm::translate(rayTraceObject->getModelMatrix(), translation));
-            currentTranslation = currentTranslation + translation;
-        }
-        else if (dynamic_cast<PointLight*>(owner)) {
-            PointLight * pointLight = dynamic_cast<PointLight*>(owner);
-            glm::vec3 translation = translationSpeed * deltaTime;
-            if (glm::length(currentTranslation + translation) > glm::length(translationRange)) {
-                translation = -translation;
-                translationSpeed = -translationSpeed;
-            }
-            pointLight->position = pointLight->position + translation;
-            currentTranslation = currentTranslation + translation;
-        
-        }
-
-    }
-private:
-    glm::vec3 translationSpeed = glm::vec3(0, 0, 0);
-    glm::vec3 translationRange = glm::vec3(0, 0, 0);
-    glm::vec3 currentTranslation = glm::vec3(0, 0, 0);
-};
-
-
-
-
-
-
 #endif
\ No newline at end of file
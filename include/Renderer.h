@@ -9,20 +9,48 @@
 #include <Camera.h>
 #include <Scene.h>
 #include <FrameRateMonitor.h>
+#include <GPUProfiler.h>
+#include <IndirectDrawList.h>
+#include <Frustum.h>
+#include <OcclusionCuller.h>
+#include <ClusteredLighting.h>
 
 
 #include <iostream>
 #include <chrono>
 #include <list>
+#include <algorithm>
+#include <cstdint>
 
 
 
 
 
+// std140 layout of the RenderInfo block (shaders/object_common.glsl, the other shaders declare a prefix of it)
+// what the render queue did in the last frame
+struct RenderQueueStats {
+    int visibleObjects = 0;
+    int culledObjects = 0; // outside the view frustum
+    int drawCalls = 0; // a batch counts once, in each occlusion culling phase
+    int batchedObjects = 0;
+    int programChanges = 0;
+    int textureChanges = 0;
+    int lodObjects[4] = {0, 0, 0, 0}; // visible objects by level of detail, the last entry counts the coarser levels too
+    int pointLights = 0; // in the light clusters
+};
+
 struct UBORenderInfo {
     glm::mat4 view;
     glm::mat4 projection;
     glm::vec3 cameraPos;
+    float padding0;
+    glm::vec3 lightPos;
+    float padding1;
+    glm::vec3 lightColor;
+    float padding2;
+    glm::vec3 ambientLightColor;
+    GLint lightCount = 0;
+    glm::vec4 clusterParams; // see ClusteredLighting::getClusterParams
 };
 
 
@@ -39,9 +67,12 @@ class Renderer {
     int screen_height = 600;
     RenderContext * context;
     FrameRateMonitor * frameRateMonitor = nullptr;
+    GPUProfiler * profiler = nullptr; // optional GPU timings of the render passes
 
     GLuint global_ubo;
     UBORenderInfo uploadData;
+    const float nearPlane = 0.1f;
+    const float farPlane = 500.0f;
 
 
 	Renderer(int _screen_width, int _screen_height, Camera * camera = nullptr) : camera(camera), screen_width(_screen_width), screen_height(_screen_height) {
@@ -122,7 +153,7 @@ class Renderer {
         glBindBuffer(GL_UNIFORM_BUFFER, global_ubo);
 
         uploadData.cameraPos = camera->Position;
-        uploadData.projection = glm::perspective(glm::radians(camera->Zoom), static_cast<float>(screen_width) / static_cast<float>(screen_height), 0.1f, 500.0f);
+        uploadData.projection = glm::perspective(glm::radians(camera->Zoom), static_cast<float>(screen_width) / static_cast<float>(screen_height), nearPlane, farPlane);
         uploadData.view = camera->GetViewMatrix();
         glBufferData(GL_UNIFORM_BUFFER, sizeof(uploadData), &uploadData, GL_STATIC_DRAW);
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
@@ -143,9 +174,61 @@ class Renderer {
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
     }
 
+    // get light info: every point light of the scene and every emissive object goes to the light clusters,
+    // the first point light is also part of the per-frame UBO data
+    void updateLightData(Scene & _scene) {
+        std::vector<Light*> & sceneLights = _scene.sceneLights;
+        if (clusteredLighting == nullptr) {
+            clusteredLighting = new ClusteredLighting();
+        }
+        clusteredLighting->clear();
+        for (Light * light : sceneLights) {
+            if (light->lightType == POINT_LIGHT) {
+                PointLight * pointLight = dynamic_cast<PointLight*>(light);
+                clusteredLighting->addPointLight(pointLight->position, pointLight->color);
+            }
+        }
+        // an emissive object lights its surroundings from its center, unless a point light of the scene inside it stands for it
+        RayTraceScene * rayTraceScene = dynamic_cast<RayTraceScene*>(&_scene);
+        if (rayTraceScene != nullptr) {
+            for (RayTraceObject * object : rayTraceScene->rayTraceObjects) {
+                glm::vec3 AA, BB;
+                if (object->material.type != EMISSIVE || !object->getRenderBounds(AA, BB)) {
+                    continue;
+                }
+                bool represented = false;
+                for (Light * light : sceneLights) {
+                    PointLight * pointLight = dynamic_cast<PointLight*>(light);
+                    if (pointLight != nullptr && glm::all(glm::greaterThanEqual(pointLight->position, AA)) && glm::all(glm::lessThanEqual(pointLight->position, BB))) {
+                        represented = true;
+                        break;
+                    }
+                }
+                if (!represented) {
+                    clusteredLighting->addPointLight(0.5f * (AA + BB), object->material.baseColor);
+                }
+            }
+        }
+        if (sceneLights.size() > 0) {
+            Light * light = sceneLights[0];
+            if (light->lightType == POINT_LIGHT) {
+                PointLight * pointLight = dynamic_cast<PointLight*>(light);
+                context->lightPos = pointLight->position;
+                context->lightColor = pointLight->color;
+                context->lightCount = sceneLights.size();
+                context->ambientColor = glm::vec3(0.4,0.4,0.5);
+            }
+        }
+        uploadData.lightPos = context->lightPos;
+        uploadData.lightColor = context->lightColor;
+        uploadData.ambientLightColor = context->ambientColor;
+        uploadData.lightCount = clusteredLighting->getLightCount();
+        uploadData.clusterParams = ClusteredLighting::getClusterParams(screen_width, screen_height, nearPlane, farPlane);
+    }
+
     void updateUboData() {
 		uploadData.cameraPos = camera->Position;
-		uploadData.projection = glm::perspective(glm::radians(camera->Zoom), static_cast<float>(screen_width) / static_cast<float>(screen_height), 0.1f, 500.0f);
+		uploadData.projection = glm::perspective(glm::radians(camera->Zoom), static_cast<float>(screen_width) / static_cast<float>(screen_height), nearPlane, farPlane);
 		uploadData.view = camera->GetViewMatrix();
 	}
 
@@ -176,6 +259,7 @@ class Renderer {
 	void render(Scene & _scene, bool render_screenCanvas = false, bool render_ImGUI = true) {
         // update the UBO data
         updateUboData();
+        updateLightData(_scene);
 
         // upload the UBO data
         uploadUbo();
@@ -185,6 +269,7 @@ class Renderer {
             // for a comparison visualization
             // we preserve the color buffer, but clear the depth buffer, because we will draw the screenCanvas on top of the openGL objects
             glClear(GL_DEPTH_BUFFER_BIT); 
+            GPUProfileScope scope(profiler, "Canvas blit");
             screenCanvas->prepareDraw(context);
             screenCanvas->draw();
 
@@ -197,40 +282,244 @@ class Renderer {
 
         // debug: draw aabb in raytrace_manager
         if (GPURT_manager != nullptr) {
+            GPUProfileScope scope(profiler, "Debug AABB");
             GPURT_manager->draw_TLAS_AABB();
             //GPURT_manager->draw_BLAS_AABB();
         }
 
-        // get light info
-        std::vector<Light*> & sceneLights = _scene.sceneLights;
-        // currently we only support one light and it is a point light
-        if (sceneLights.size() > 0) {
-            Light * light = sceneLights[0];
-            if (light->lightType == POINT_LIGHT) {
-                PointLight * pointLight = dynamic_cast<PointLight*>(light);
-                context->lightPos = pointLight->position;
-                context->lightColor = pointLight->color;
-                context->lightCount = sceneLights.size();
-                context->ambientColor = glm::vec3(0.4,0.4,0.5);
-            }
-        }
-
+        clusteredLighting->update(uploadData.view, uploadData.projection, screen_width, screen_height, nearPlane, farPlane, profiler);
 
         std::vector<std::shared_ptr<RenderComponent>> & renderQueue = _scene.renderQueue;
         // render the scene using openGL rasterization pipeline
-        for (auto renderComponent : renderQueue) {
-            if (renderComponent->active) {
-                renderComponent->Render();
-            }
-        }
+        GPUProfileScope scope(profiler, "Render queue");
+        drawRenderQueue(renderQueue);
         
 
 	}
 
+    // submit the opaque MeshPool objects with glMultiDrawElementsIndirect, or else with one instanced draw per mesh
+    void setMultiDrawIndirect(bool enable) { useMultiDrawIndirect = enable; }
+    bool getMultiDrawIndirect() const { return useMultiDrawIndirect; }
+    // skip the components whose bounds are outside the view frustum
+    void setFrustumCulling(bool enable) { useFrustumCulling = enable; }
+    bool getFrustumCulling() const { return useFrustumCulling; }
+    // two-phase Hi-Z occlusion culling of the batched objects, it needs multi-draw indirect
+    void setOcclusionCulling(bool enable) { useOcclusionCulling = enable; }
+    bool getOcclusionCulling() const { return useOcclusionCulling; }
+    // draw the meshes at a level of detail matching their size on screen
+    void setMeshLODs(bool enable) { useMeshLODs = enable; }
+    bool getMeshLODs() const { return useMeshLODs; }
+    // counts of the last frame
+    const RenderQueueStats & getStats() const { return stats; }
+
 
     private:
     //----------------------------------------------------------------------------------
     const bool _vSync = true; // Enable vsync
+    bool useMultiDrawIndirect = true;
+    bool useFrustumCulling = true;
+    bool useOcclusionCulling = true;
+    bool useMeshLODs = true;
+    // an object whose bounding sphere covers this fraction of the screen height (or more) is drawn at full detail,
+    // every halving of its size on screen selects the next level of detail
+    const float lodReferenceSize = 0.5f;
+    IndirectDrawList * drawList = nullptr; // created with the first frame
+    OcclusionCuller * occlusionCuller = nullptr; // created when the occlusion culling is first used
+    ClusteredLighting * clusteredLighting = nullptr; // created with the first frame
+    RenderQueueStats stats;
+    // an active component that passed the culling, with its sort key
+    struct QueueEntry {
+        uint64_t key;
+        int component; // in the render queue
+        glm::vec3 AA, BB; // world space bounds, AA > BB if the component has none
+        bool operator<(const QueueEntry & other) const {
+            return key != other.key ? key < other.key : component < other.component;
+        }
+    };
+    // a component drawn by itself (drawCount 0), or a batch of the draw list
+    struct Batch {
+        int component; // the first one, in the render queue
+        int firstDraw;
+        int drawCount;
+    };
+    // per-frame scratch of drawRenderQueue, kept to avoid reallocating it
+    std::vector<QueueEntry> visibleEntries;
+    std::vector<Batch> batches;
+
+    // draw the active components that intersect the view frustum, in the order of their sort keys
+    // adjacent opaque objects of the MeshPool sharing program and textures are batched: with multi-draw indirect a batch is
+    // one glMultiDrawElementsIndirect over any meshes, without it one instanced draw over the objects of the same mesh
+    // (the sort keys make such objects adjacent); the other components are drawn one by one
+    void drawRenderQueue(const std::vector<std::shared_ptr<RenderComponent>> & renderQueue) {
+        if (drawList == nullptr) {
+            drawList = new IndirectDrawList();
+        }
+        stats = RenderQueueStats();
+        stats.pointLights = clusteredLighting->getLightCount();
+        Frustum frustum(uploadData.projection * uploadData.view);
+        visibleEntries.clear();
+        for (size_t i = 0; i < renderQueue.size(); i++) {
+            const RenderComponent * component = renderQueue[i].get();
+            if (!component->active) {
+                continue;
+            }
+            glm::vec3 AA, BB;
+            float depth = 0.0f;
+            if (component->getWorldBounds(AA, BB)) {
+                if (useFrustumCulling && !frustum.intersectsAABB(AA, BB)) {
+                    stats.culledObjects++;
+                    continue;
+                }
+                depth = glm::dot(0.5f * (AA + BB) - camera->Position, camera->Front);
+                selectLOD(component->getDrawObject(), AA, BB);
+            }
+            else {
+                AA = glm::vec3(1.0f);
+                BB = glm::vec3(-1.0f);
+            }
+            visibleEntries.push_back({makeSortKey(component, depth), (int)i, AA, BB});
+        }
+        std::sort(visibleEntries.begin(), visibleEntries.end());
+        stats.visibleObjects = visibleEntries.size();
+
+        batches.clear();
+        drawList->clear();
+        size_t i = 0;
+        while (i < visibleEntries.size()) {
+            GMVPObject * object = getBatchCandidate(renderQueue[visibleEntries[i].component].get());
+            if (object == nullptr) {
+                batches.push_back({visibleEntries[i].component, 0, 0});
+                i++;
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < visibleEntries.size()) {
+                GMVPObject * next = getBatchCandidate(renderQueue[visibleEntries[end].component].get());
+                if (next == nullptr || !(useMultiDrawIndirect ? object->canBatchWith(next) : object->canDrawInstancedWith(next))) {
+                    break;
+                }
+                end++;
+            }
+            int firstDraw = drawList->size();
+            for (size_t j = i; j < end; j++) {
+                GMVPObject * batched = renderQueue[visibleEntries[j].component]->getDrawObject();
+                drawList->add(batched->getLODMesh(), batched->getObjectIndex(), visibleEntries[j].AA, visibleEntries[j].BB);
+            }
+            batches.push_back({visibleEntries[i].component, firstDraw, drawList->size() - firstDraw});
+            i = end;
+        }
+
+        // the transforms and materials changed since the last frame (and the records of the new objects), in one upload,
+        // then the draw records and their commands
+        ObjectDataBuffer::get().upload();
+        bool occlusionCulling = useOcclusionCulling && useMultiDrawIndirect && drawList->size() > 0;
+        if (occlusionCulling) {
+            if (occlusionCuller == nullptr) {
+                occlusionCuller = new OcclusionCuller();
+            }
+            occlusionCuller->bindVisibility(ObjectDataBuffer::get().getSlotCount());
+        }
+        drawList->upload(occlusionCulling);
+
+        stats.batchedObjects = drawList->size();
+        // the opaque queue comes first, it is the one occluding and being occluded
+        int opaqueEnd = 0;
+        while (opaqueEnd < (int)batches.size() && renderQueue[batches[opaqueEnd].component]->renderPriority == OPAQUE) {
+            opaqueEnd++;
+        }
+        drawBatches(renderQueue, 0, opaqueEnd, false);
+        if (occlusionCulling) {
+            GPUProfileScope scope(profiler, "Occlusion culling");
+            occlusionCuller->cull(*drawList, uploadData.projection * uploadData.view, screen_width, screen_height, profiler);
+            drawBatches(renderQueue, 0, opaqueEnd, true);
+        }
+        drawBatches(renderQueue, opaqueEnd, batches.size(), false);
+    }
+
+    // draw batches [begin, end); the second occlusion culling phase only draws the batched objects, with its own commands
+    void drawBatches(const std::vector<std::shared_ptr<RenderComponent>> & renderQueue, int begin, int end, bool occlusionPhase) {
+        const Shader * lastProgram = nullptr;
+        const Texture * lastTexture = nullptr;
+        for (int i = begin; i < end; i++) {
+            const Batch & batch = batches[i];
+            if (occlusionPhase && batch.drawCount == 0) {
+                continue;
+            }
+            RenderComponent * component = renderQueue[batch.component].get();
+            GMVPObject * object = component->getDrawObject();
+            const Texture * texture = (object != nullptr && object->hasTexture) ? object->texture : nullptr;
+            stats.programChanges += (component->getProgram() != lastProgram) ? 1 : 0;
+            stats.textureChanges += (texture != lastTexture) ? 1 : 0;
+            lastProgram = component->getProgram();
+            lastTexture = texture;
+            if (batch.drawCount == 0) {
+                component->Render();
+            }
+            else {
+                object->bindBatch();
+                if (occlusionPhase) {
+                    drawList->drawIndirect(batch.firstDraw, batch.drawCount, occlusionCuller->getCommandBuffer());
+                }
+                else if (useMultiDrawIndirect) {
+                    drawList->drawIndirect(batch.firstDraw, batch.drawCount);
+                }
+                else {
+                    drawList->drawInstanced(batch.firstDraw, batch.drawCount);
+                }
+            }
+            stats.drawCalls++;
+        }
+    }
+
+    // the object of an opaque component, if it draws a MeshPool mesh
+    static GMVPObject * getBatchCandidate(const RenderComponent * component) {
+        if (component->renderPriority != OPAQUE) {
+            return nullptr;
+        }
+        GMVPObject * object = component->getDrawObject();
+        if (object == nullptr || object->mesh < 0) {
+            return nullptr;
+        }
+        return object;
+    }
+
+    // the level of detail of the object from the size of its bounding sphere on screen (full detail when the camera is inside it)
+    void selectLOD(GMVPObject * object, const glm::vec3 & AA, const glm::vec3 & BB) {
+        if (object == nullptr) {
+            return;
+        }
+        int level = 0;
+        if (useMeshLODs) {
+            float radius = 0.5f * glm::length(BB - AA);
+            float distance = glm::length(0.5f * (AA + BB) - camera->Position);
+            if (distance > radius) {
+                float screenSize = radius / (distance * glm::tan(0.5f * glm::radians(camera->Zoom)));
+                level = (int)glm::floor(glm::log2(lodReferenceSize / glm::max(screenSize, 1e-6f)));
+            }
+        }
+        object->setLODLevel(level);
+        stats.lodObjects[glm::min(object->lodLevel, 3)]++;
+    }
+
+    // the draw order, from the most significant bits: queue (2), then
+    // opaque and skybox: program (12), texture (12), then front to back depth (24) and mesh (14) with multi-draw indirect,
+    //                    or mesh and depth without it, so the instances of a mesh are adjacent
+    // transparent:       back to front depth (24), program (12), texture (12)
+    // the program and texture names are truncated, a collision only costs a state change
+    uint64_t makeSortKey(const RenderComponent * component, float depth) const {
+        uint64_t queue = component->renderPriority;
+        const Shader * program = component->getProgram();
+        uint64_t programBits = (program == nullptr) ? 0 : (program->ID & 0xFFF);
+        GMVPObject * object = component->getDrawObject();
+        uint64_t textureBits = (object != nullptr && object->hasTexture) ? (object->texture->getTextureRef() & 0xFFF) : 0;
+        uint64_t meshBits = (object == nullptr || object->mesh < 0) ? 0 : ((object->getLODMesh() + 1) & 0x3FFF);
+        uint64_t depthBits = (uint64_t)(glm::clamp(depth / farPlane, 0.0f, 1.0f) * 0xFFFFFF);
+        if (component->renderPriority == TRANSPARENT) {
+            return (queue << 62) | ((0xFFFFFF - depthBits) << 38) | (programBits << 26) | (textureBits << 14);
+        }
+        uint64_t order = useMultiDrawIndirect ? ((depthBits << 14) | meshBits) : ((meshBits << 24) | depthBits);
+        return (queue << 62) | (programBits << 50) | (textureBits << 38) | order;
+    }
 
 };
 
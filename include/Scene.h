@@ -11,7 +11,10 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include "RayTraceObject.h"
+#include "TransformSystem.h"
+#include <TaskScheduler.h>
 #include <Shader.h>
+#include <ShaderRegistry.h>
 
 
 
@@ -24,10 +27,25 @@ public:
     std::vector<SceneObject*> sceneObjects;
     std::vector<std::shared_ptr<RenderComponent>> renderQueue; // object components to be rendered each frame
     std::vector<Light*> sceneLights; // point lights in the scene
+    TransformSystem transforms; // the animated transforms of the objects and lights, updated once per tick
 
+    // sort the renderQueue based on renderPriority, the lower the renderPriority, the earlier it is rendered
+    // opaque components are also grouped by program, since the objects sharing a program can be drawn without switching it
+    // and then by mesh, so the objects of a mesh are adjacent and the renderer can also batch them without multi-draw indirect
+    // (the order of the other queues is kept, transparent objects depend on it)
+    // the renderer sorts the visible components again every frame with their depth (Renderer::makeSortKey), this order breaks the ties
     void sortRenderQueue() {
-        std::sort(renderQueue.begin(), renderQueue.end(), [](std::shared_ptr<RenderComponent> a, std::shared_ptr<RenderComponent> b) {
-            return a->renderPriority < b->renderPriority;
+        std::stable_sort(renderQueue.begin(), renderQueue.end(), [](const std::shared_ptr<RenderComponent> & a, const std::shared_ptr<RenderComponent> & b) {
+            if (a->renderPriority != b->renderPriority) {
+                return a->renderPriority < b->renderPriority;
+            }
+            if (a->renderPriority != OPAQUE) {
+                return false;
+            }
+            if (a->getProgram() != b->getProgram()) {
+                return std::less<const Shader*>()(a->getProgram(), b->getProgram());
+            }
+            return getMesh(a.get()) < getMesh(b.get());
         });
     }
 
@@ -39,6 +57,13 @@ public:
             delete sceneObject;
         }
     }
+
+private:
+    // the MeshPool mesh a component draws, -1 if it does not draw one
+    static int getMesh(const RenderComponent * component) {
+        GMVPObject * object = component->getDrawObject();
+        return (object == nullptr) ? -1 : object->mesh;
+    }
 };
 
 
@@ -62,14 +87,38 @@ public:
         glm::vec3 v0(-1, 2, -0.2);
         glm::vec3 v1(1, 2, 0.2);
         glm::vec3 v2(0, 4, 0);
+
+        // loading: the images are decoded and the models imported on the workers of the TaskScheduler, the main thread
+        // creates the GL objects as their inputs arrive, then the objects build their BLAS and CPU BVH in parallel
+        TaskScheduler & scheduler = TaskScheduler::get();
+        skyboxTexture = new SkyboxTexture();
+        TaskHandle skyboxDecode = scheduler.submit([this] { skyboxTexture->loadFromFolder("resource/skybox"); });
+        Texture * waifuTexture = new Texture();
+        TaskHandle waifuTextureDecode = scheduler.submit([waifuTexture] {
+            waifuTexture->loadFromFile("resource/mebius_diffuse.png");
+            waifuTexture->removeAlphaChannel();
+            waifuTexture->resizeData(1024, 1024,3);
+        });
+        GModel * waifu = nullptr;
+        TaskHandle waifuImport = scheduler.submit([&waifu] { waifu = new GModel("resource/mebius.obj", false); });
+        Texture * earthTexture = new Texture();
+        TaskHandle earthTextureDecode = scheduler.submit([earthTexture] { earthTexture->loadFromFile("resource/earthmap.jpg"); });
+        Texture * cubeTexture = new Texture();
+        TaskHandle cubeTextureDecode = scheduler.submit([cubeTexture] { cubeTexture->loadFromFile("resource/night.png"); });
+        GModel * cubeObject = nullptr;
+        TaskHandle cubeImport = scheduler.submit([&cubeObject] { cubeObject = new GModel("resource/cube.obj", false); });
+        // the GL textures as soon as their images are decoded
+        TaskHandle waifuTextureUpload = scheduler.submitMainThread([waifuTexture] { waifuTexture->createGPUTexture(); }, {waifuTextureDecode});
+        TaskHandle earthTextureUpload = scheduler.submitMainThread([earthTexture] { earthTexture->createGPUTexture(); }, {earthTextureDecode});
+        TaskHandle cubeTextureUpload = scheduler.submitMainThread([cubeTexture] { cubeTexture->createGPUTexture(); }, {cubeTextureDecode});
+        std::vector<TaskHandle> objectBuilds; // RayTraceObject::update() of every object
         
         
         // skybox
-        skyboxTexture = new SkyboxTexture();
-        skyboxTexture->loadFromFolder("resource/skybox");
+        scheduler.wait(skyboxDecode);
         skyboxTexture->createSkyboxTexture();
         GSkybox * _skybox = new GSkybox();
-        _skybox->setShader(new Shader("shaders/skybox_shader.vert", "shaders/skybox_shader.frag"));
+        _skybox->setShader(ShaderRegistry::get().getShader("shaders/skybox_shader.vert", "shaders/skybox_shader.frag"));
         _skybox->setTexture(skyboxTexture);
         RayTraceSkybox * rayTraceSkybox = new RayTraceSkybox(_skybox);
         CPURT_skybox = *rayTraceSkybox->CPU_skybox;
@@ -77,17 +126,14 @@ public:
         
         
         // waifu, would be a performance bottleneck because of the high triangle count
-        Texture * waifuTexture = new Texture();
-        waifuTexture->loadFromFile("resource/mebius_diffuse.png");
-        waifuTexture->removeAlphaChannel();
-        waifuTexture->resizeData(1024, 1024,3);
-        waifuTexture->createGPUTexture();
-        GModel* waifu = new GModel("resource/mebius.obj");
+        scheduler.wait({waifuTextureUpload, waifuImport});
+        waifu->uploadGeometry();
         waifu->setSkyboxTexture(skyboxTexture);
         RayTraceObject * rayTraceObject7 = new RayTraceObject(waifu,OPAQUE,renderContext);
         rayTraceObject7->setMaterial(LAMBERTIAN, 1.5, glm::vec4(1.0,1.0,1.0, 1.0), waifuTexture);
         rayTraceObject7->setModelMatrix(glm::translate(glm::mat4(1.0), glm::vec3(0, 2, 2.2)) * glm::rotate(identity, glm::radians(-95.0f), rotationAxis) * glm::scale(glm::mat4(1.0), glm::vec3(0.08, 0.08, 0.08)));
-        rayTraceObject7->update();
+        objectBuilds.push_back(scheduler.submit([rayTraceObject7] { rayTraceObject7->update(); }));
+        rayTraceObject7->setStatic(true);
         rayTraceObjects.push_back(rayTraceObject7);
         rayTraceObject7->attachToSceneRenderList(renderQueue);
         
@@ -99,22 +145,22 @@ public:
         RayTraceObject * rayTraceObject2 = new RayTraceObject(sphereObject2,OPAQUE,renderContext);
         rayTraceObject2->setMaterial(LAMBERTIAN, 0.0, glm::vec4(0.5, 0.5, 0.5, 1.0));
         rayTraceObject2->setModelMatrix(glm::translate(glm::mat4(1.0), glm::vec3(0, -100, 0)) * glm::scale(glm::mat4(1.0), glm::vec3(100, 100, 100)));
-        rayTraceObject2->update();
+        objectBuilds.push_back(scheduler.submit([rayTraceObject2] { rayTraceObject2->update(); }));
+        rayTraceObject2->setStatic(true);
         rayTraceObjects.push_back(rayTraceObject2);
         rayTraceObject2->attachToSceneRenderList(renderQueue);
         
         
         // the earth sphere
-        Texture * earthTexture = new Texture();
-        earthTexture->loadFromFile("resource/earthmap.jpg");
-        earthTexture->createGPUTexture();
+        scheduler.wait(earthTextureUpload);
         GSphere* sphereObject3 = new GSphere();
         sphereObject3->setSkyboxTexture(skyboxTexture);
         RayTraceObject * rayTraceObject3 = new RayTraceObject(sphereObject3,OPAQUE,renderContext);
         rayTraceObject3->setMaterial(LAMBERTIAN, 0.0, glm::vec4(1.0, 1.0, 1.0, 1.0), earthTexture);
         
         rayTraceObject3->setModelMatrix(glm::translate(glm::mat4(1.0), glm::vec3(0, 1, 2.2)) * glm::rotate(identity, glm::radians(90.0f), rotationAxis) *glm::scale(glm::mat4(1.0), glm::vec3(1, 1, 1)));
-        rayTraceObject3->update();
+        objectBuilds.push_back(scheduler.submit([rayTraceObject3] { rayTraceObject3->update(); }));
+        rayTraceObject3->setStatic(true);
         rayTraceObjects.push_back(rayTraceObject3);
         rayTraceObject3->attachToSceneRenderList(renderQueue);
         
@@ -125,7 +171,8 @@ public:
         RayTraceObject * rayTraceObject4 = new RayTraceObject(sphereObject4,OPAQUE,renderContext);
         rayTraceObject4->setMaterial(METAL, 0.2, glm::vec4(0.7, 0.6, 0.5, 1.0));
         rayTraceObject4->setModelMatrix(glm::translate(glm::mat4(1.0), glm::vec3(0, 1, 0)) * glm::scale(glm::mat4(1.0), glm::vec3(1, 1, 1)));
-        rayTraceObject4->update();
+        objectBuilds.push_back(scheduler.submit([rayTraceObject4] { rayTraceObject4->update(); }));
+        rayTraceObject4->setStatic(true);
         rayTraceObjects.push_back(rayTraceObject4);
         rayTraceObject4->attachToSceneRenderList(renderQueue);
         
@@ -135,19 +182,17 @@ public:
         RayTraceObject * rayTraceObject5 = new RayTraceObject(sphereObject5,OPAQUE,renderContext);
         rayTraceObject5->setMaterial(EMISSIVE, 0.0, glm::vec4(2, 2, 2, 1.0));
         rayTraceObject5->setModelMatrix(glm::translate(glm::mat4(1.0), glm::vec3(1.5, 0.45, 0)) * glm::scale(glm::mat4(1.0), glm::vec3(0.5, 0.5, 0.5)));
-        rayTraceObject5->update();
+        objectBuilds.push_back(scheduler.submit([rayTraceObject5] { rayTraceObject5->update(); }));
         rayTraceObjects.push_back(rayTraceObject5);
         rayTraceObject5->attachToSceneRenderList(renderQueue);
         // record the light source to sceneObjects
         PointLight * sphereObject5Light = new PointLight(glm::vec3(1.5, 0.45, 0), glm::vec3(2, 2, 2));
-        sceneObjects.push_back(sphereObject5Light); // then such light can be updated in the logic loop by ticking its component
+        sceneObjects.push_back(sphereObject5Light); // owned (and deleted) with the scene objects, its position is animated by the TransformSystem
         sceneLights.push_back(sphereObject5Light);
-        // add periodic translation component to the light source mesh
-        std::unique_ptr<ObjectPeriodicTranslationComponent> sphereObject5TranslationComponent = std::make_unique<ObjectPeriodicTranslationComponent>(glm::vec3(0, 0, 1), glm::vec3(0, 0, 1));
-        rayTraceObject5->addComponent(std::move(sphereObject5TranslationComponent));
-        // we also update the light source Light object in the logic loop by ticking its component
-        std::unique_ptr<ObjectPeriodicTranslationComponent> sphereObject5TranslationComponent2 = std::make_unique<ObjectPeriodicTranslationComponent>(glm::vec3(0, 0, 1), glm::vec3(0, 0, 1));
-        sphereObject5Light->addComponent(std::move(sphereObject5TranslationComponent2));
+        // periodic translation of the light source mesh
+        transforms.addPeriodicTranslation(transforms.addObject(rayTraceObject5), glm::vec3(0, 0, 1), glm::vec3(0, 0, 1));
+        // the light source Light object moves along with it
+        transforms.addPeriodicTranslation(transforms.addLight(sphereObject5Light), glm::vec3(0, 0, 1), glm::vec3(0, 0, 1));
         
         
         GTriangle* triangleObject = new GTriangle(v0, v1, v2);
@@ -155,26 +200,24 @@ public:
         RayTraceObject * rayTraceObject6 = new RayTraceObject(triangleObject,OPAQUE,renderContext);
         rayTraceObject6->setMaterial(LAMBERTIAN, 0.0, glm::vec4(0.5, 0.5, 0.5, 1.0));
         rayTraceObject6->setModelMatrix(glm::translate(glm::mat4(1.0), glm::vec3(0, 0, 0)) * glm::scale(glm::mat4(1.0), glm::vec3(1, 1, 1)));
-        rayTraceObject6->update();
+        objectBuilds.push_back(scheduler.submit([rayTraceObject6] { rayTraceObject6->update(); }));
+        rayTraceObject6->setStatic(true);
         rayTraceObjects.push_back(rayTraceObject6);
         rayTraceObject6->attachToSceneRenderList(renderQueue);
         
         
         // the cube
-        Texture * cubeTexture = new Texture();
-        cubeTexture->loadFromFile("resource/night.png");
-        cubeTexture->createGPUTexture();
-        GModel* cubeObject = new GModel("resource/cube.obj");
+        scheduler.wait({cubeTextureUpload, cubeImport});
+        cubeObject->uploadGeometry();
         cubeObject->setSkyboxTexture(skyboxTexture);
         RayTraceObject * rayTraceObject8 = new RayTraceObject(cubeObject,OPAQUE,renderContext);
         rayTraceObject8->setMaterial(LAMBERTIAN, 0.0, glm::vec4(1.0, 1.0, 1.0, 1.0), cubeTexture);
         rayTraceObject8->setModelMatrix(glm::translate(glm::mat4(1.0), glm::vec3(1.5, 0.5, 2.0)) * glm::scale(glm::mat4(1.0), glm::vec3(0.5, 0.5, 0.5)));
-        rayTraceObject8->update();
+        objectBuilds.push_back(scheduler.submit([rayTraceObject8] { rayTraceObject8->update(); }));
         rayTraceObjects.push_back(rayTraceObject8);
         rayTraceObject8->attachToSceneRenderList(renderQueue);
         // add rotation component to the cube
-        std::unique_ptr<ObjectRotationComponent> cubeRotationComponent = std::make_unique<ObjectRotationComponent>(4.0f);
-        rayTraceObject8->addComponent(std::move(cubeRotationComponent));
+        transforms.addRotation(transforms.addObject(rayTraceObject8), 4.0f);
         
         // the glass sphere (transparent object in rendering order)
         GSphere * sphereObject = new GSphere();
@@ -182,17 +225,15 @@ public:
         RayTraceObject * rayTraceObject1 = new RayTraceObject(sphereObject,TRANSPARENT,renderContext);
         rayTraceObject1->setMaterial(DIELECTRIC, 1.5, glm::vec4(0.3, 0.4, 0.8, 0.6));
         rayTraceObject1->setModelMatrix(glm::translate(glm::mat4(1.0), glm::vec3(0, 1, -2.2)) * glm::scale(glm::mat4(1.0), glm::vec3(1, 1, 1)));
-        rayTraceObject1->update();
+        objectBuilds.push_back(scheduler.submit([rayTraceObject1] { rayTraceObject1->update(); }));
+        rayTraceObject1->setStatic(true);
         rayTraceObjects.push_back(rayTraceObject1);
         rayTraceObject1->attachToSceneRenderList(renderQueue);
         
         
         
-        // sort the renderQueue based on renderPriority
-        // the lower the renderPriority, the earlier it is rendered
-        std::sort(renderQueue.begin(), renderQueue.end(), [](std::shared_ptr<RenderComponent> a, std::shared_ptr<RenderComponent> b) {
-            return a->renderPriority < b->renderPriority;
-        });
+        // sort the renderQueue based on renderPriority and program
+        sortRenderQueue();
 
 
         // remember to add all these RayTraceObjects to sceneObjects
@@ -202,6 +243,7 @@ public:
     
     
         // ------------------ temporary, now use a hittable_list to store all objects which can be parsed to the CPU ray tracer ------------------
+        scheduler.wait(objectBuilds);
         for(RayTraceObject* rayTraceObject : rayTraceObjects) {
                 CPURT_objects.add(rayTraceObject->CPU_object);
         }
@@ -7,6 +7,8 @@
 
 class SceneObject {
 public:
+    virtual ~SceneObject() {}
+
     void addComponent(std::unique_ptr<IComponent> component) {
         // each component should only belong to one object
         // so we should check if the component is already attached to another object
@@ -3,11 +3,16 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <ShaderCache.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <set>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 
 class Shader
 {
@@ -15,35 +20,23 @@ public:
     unsigned int ID;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath) : Shader(vertexPath, fragmentPath, std::vector<std::string>()) {}
+
+    // compile a variant: every entry of 'defines' ("NAME" or "NAME VALUE") becomes a #define line after #version in both stages
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> & defines)
     {
         // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+        std::set<std::string> vertexIncludes, fragmentIncludes;
+        std::string vertexCode = injectDefines(readSource(vertexPath, vertexIncludes), defines);
+        std::string fragmentCode = injectDefines(readSource(fragmentPath, fragmentIncludes), defines);
+        ShaderCacheTimer timer;
+        std::string cacheKey = ShaderCache::get().makeKey({vertexCode, fragmentCode});
+        ID = glCreateProgram();
+        // a program linked before by this driver is loaded from the on-disk cache
+        if (ShaderCache::get().load(ID, cacheKey)) {
+            ShaderCache::get().addProgram(true, timer.elapsedMilliseconds());
+            reflectUniforms();
+            return;
         }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
@@ -60,14 +53,14 @@ public:
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        linkAndCache(cacheKey);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        reflectUniforms();
+        ShaderCache::get().addProgram(false, timer.elapsedMilliseconds());
 
     }
     // default constructor, just for inheritance, do nothing
@@ -79,66 +72,176 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // location of an active uniform from the table built at link time, -1 for a uniform the program does not use
+    // (like glGetUniformLocation, the glUniform* calls ignore -1)
+    GLint getUniformLocation(const std::string &name) const
+    {
+        auto it = uniformLocations.find(name);
+        return (it != uniformLocations.end()) ? it->second : -1;
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(getUniformLocation(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(getUniformLocation(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(getUniformLocation(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(getUniformLocation(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 protected:
+    // read a shader file and expand its '#include "file"' lines (paths relative to the including file) recursively
+    // every file is expanded once, so shared code can be included from several places without redefinitions
+    static std::string readSource(const std::string & path, std::set<std::string> & includedFiles)
+    {
+        if (!includedFiles.insert(path).second) {
+            return "";
+        }
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return "";
+        }
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        std::stringstream source;
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t");
+            if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+                size_t open = line.find('"', start);
+                size_t close = (open == std::string::npos) ? std::string::npos : line.find('"', open + 1);
+                if (close == std::string::npos) {
+                    std::cout << "ERROR::SHADER::INVALID_INCLUDE in " << path << ": " << line << std::endl;
+                    continue;
+                }
+                source << readSource(directory + line.substr(open + 1, close - open - 1), includedFiles);
+                continue;
+            }
+            source << line << '\n';
+        }
+        return source.str();
+    }
+
+    // the #version directive must stay the first line, the defines go right after it
+    static std::string injectDefines(const std::string & source, const std::vector<std::string> & defines)
+    {
+        if (defines.empty()) {
+            return source;
+        }
+        std::string defineLines;
+        for (const std::string & define : defines) {
+            defineLines += "#define " + define + "\n";
+        }
+        size_t versionLine = source.find("#version");
+        size_t insertPosition = (versionLine == std::string::npos) ? 0 : source.find('\n', versionLine);
+        if (insertPosition == std::string::npos) {
+            return source + "\n" + defineLines;
+        }
+        if (versionLine != std::string::npos) {
+            insertPosition++;
+        }
+        return source.substr(0, insertPosition) + defineLines + source.substr(insertPosition);
+    }
+
+    // locations of the active uniforms, read once after linking so that setting a uniform does not query the driver
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    // fill uniformLocations: every active uniform by its name, and every element of an array as "name[i]" (and "name" for element 0)
+    // the uniforms inside blocks have no location and are skipped
+    void reflectUniforms()
+    {
+        uniformLocations.clear();
+        GLint uniformCount = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+        GLint maxNameLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        std::vector<GLchar> nameBuffer(std::max(maxNameLength, 1));
+        for (GLint i = 0; i < uniformCount; i++) {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, nameBuffer.size(), nullptr, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data());
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0) {
+                continue;
+            }
+            // an array of a basic type is reported once, as "name[0]" (the members of struct arrays are reported one by one)
+            const std::string arraySuffix = "[0]";
+            if (name.size() <= arraySuffix.size() || name.compare(name.size() - arraySuffix.size(), arraySuffix.size(), arraySuffix) != 0) {
+                uniformLocations[name] = location;
+                continue;
+            }
+            std::string baseName = name.substr(0, name.size() - arraySuffix.size());
+            uniformLocations[baseName] = location;
+            for (GLint element = 0; element < size; element++) {
+                std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+            }
+        }
+    }
+
+    // link the program with its attached shaders, and store the binary in the shader cache if linking succeeded
+    void linkAndCache(const std::string & cacheKey)
+    {
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        GLint success = 0;
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        if (success) {
+            ShaderCache::get().save(ID, cacheKey);
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -170,25 +273,20 @@ protected:
 class ComputeShader : public Shader
 {
     public:
-    ComputeShader(const char* computePath){
-        std::string computeCode;
-        std::ifstream cShaderFile;
-        cShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            cShaderFile.open(computePath);
-            std::stringstream cShaderStream;
-            // read file's buffer contents into streams
-            cShaderStream << cShaderFile.rdbuf();
-            // close file handlers
-            cShaderFile.close();
-            // convert stream into string
-            computeCode = cShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
+    ComputeShader(const char* computePath) : ComputeShader(computePath, std::vector<std::string>()) {}
+
+    // compile a specialized variant: every entry of 'defines' ("NAME" or "NAME VALUE") becomes a #define line after #version
+    ComputeShader(const char* computePath, const std::vector<std::string> & defines){
+        std::set<std::string> includedFiles;
+        std::string computeCode = injectDefines(readSource(computePath, includedFiles), defines);
+        ShaderCacheTimer timer;
+        std::string cacheKey = ShaderCache::get().makeKey({computeCode});
+        ID = glCreateProgram();
+        // a program linked before by this driver is loaded from the on-disk cache
+        if (ShaderCache::get().load(ID, cacheKey)) {
+            ShaderCache::get().addProgram(true, timer.elapsedMilliseconds());
+            reflectUniforms();
+            return;
         }
         const char* cShaderCode = computeCode.c_str();
         // 2. compile shaders
@@ -199,14 +297,15 @@ class ComputeShader : public Shader
         glCompileShader(compute);
         checkCompileErrors(compute, "COMPUTE");
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, compute);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        linkAndCache(cacheKey);
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(compute);
+        reflectUniforms();
+        ShaderCache::get().addProgram(false, timer.elapsedMilliseconds());
 
     }
+
 };
 
 
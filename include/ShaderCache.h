@@ -0,0 +1,185 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// on-disk cache of linked shader programs (glGetProgramBinary / glProgramBinary)
+// a program is keyed by a hash of its final sources (includes expanded, defines injected) and of the driver strings,
+// so editing a shader or updating the driver gives a new key; a binary the driver rejects anyway is recompiled and replaced
+class ShaderCache
+{
+public:
+    static ShaderCache & get()
+    {
+        static ShaderCache cache;
+        return cache;
+    }
+
+    void setEnabled(bool enable) { enabled = enable; }
+    void setDirectory(const std::string & _directory) { directory = _directory; }
+
+    // key of a program built from the given stage sources
+    std::string makeKey(const std::vector<std::string> & sources)
+    {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+        for (const std::string & source : sources) {
+            hash = fnv1a(hash, source);
+            hash = fnv1a(hash, std::string(1, '\0')); // stage separator
+        }
+        hash = fnv1a(hash, getDriverString());
+        std::stringstream key;
+        key << std::hex << hash;
+        return key.str();
+    }
+
+    // try to load the program binary into 'program', false if it is not cached or the driver rejects it
+    bool load(GLuint program, const std::string & key)
+    {
+        if (!isAvailable()) {
+            return false;
+        }
+        std::ifstream file(getPath(key), std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        GLenum format = 0;
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (format == 0 || binary.empty()) {
+            return false;
+        }
+        glProgramBinary(program, format, binary.data(), binary.size());
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            std::cout << "[ShaderCache]: cached binary " << key << " was rejected by the driver, recompiling" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // store a linked program, it must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    void save(GLuint program, const std::string & key)
+    {
+        if (!isAvailable()) {
+            return;
+        }
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, nullptr, &format, binary.data());
+        makeDirectory();
+        std::ofstream file(getPath(key), std::ios::binary);
+        if (!file.is_open()) {
+            std::cout << "[ShaderCache]: error: cannot write " << getPath(key) << std::endl;
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(binary.data(), binary.size());
+    }
+
+    // bookkeeping for the startup report
+    void addProgram(bool fromCache, double milliseconds)
+    {
+        (fromCache ? hits : misses)++;
+        totalMilliseconds += milliseconds;
+    }
+
+    // cold: everything compiled from source, warm: everything loaded from the cache
+    void printStats() const
+    {
+        const char * start = (misses == 0) ? "warm" : ((hits == 0) ? "cold" : "partially warm");
+        std::cout << "[ShaderCache]: " << start << " start, " << hits << " programs loaded from the cache, " << misses
+                  << " compiled, " << totalMilliseconds << " ms in total" << std::endl;
+    }
+
+    bool isAvailable()
+    {
+        if (!enabled) {
+            return false;
+        }
+        if (binaryFormatCount < 0) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+        }
+        return binaryFormatCount > 0;
+    }
+
+private:
+    bool enabled = true;
+    std::string directory = "shader_cache";
+    GLint binaryFormatCount = -1; // queried on first use, the driver may not support any binary format
+    int hits = 0;
+    int misses = 0;
+    double totalMilliseconds = 0.0;
+
+    ShaderCache() {}
+
+    static uint64_t fnv1a(uint64_t hash, const std::string & data)
+    {
+        for (unsigned char c : data) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::string getDriverString()
+    {
+        std::string driver;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const GLubyte * value = glGetString(name);
+            driver += (value == nullptr) ? "" : reinterpret_cast<const char*>(value);
+            driver += '\n';
+        }
+        return driver;
+    }
+
+    std::string getPath(const std::string & key) const
+    {
+        return directory + "/" + key + ".bin";
+    }
+
+    void makeDirectory() const
+    {
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    ShaderCache(const ShaderCache&) = delete;
+    ShaderCache& operator=(const ShaderCache&) = delete;
+};
+
+// measures the creation of one program for the startup report
+class ShaderCacheTimer
+{
+public:
+    ShaderCacheTimer() : start(std::chrono::high_resolution_clock::now()) {}
+    double elapsedMilliseconds() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+private:
+    std::chrono::high_resolution_clock::time_point start;
+};
+
+#endif
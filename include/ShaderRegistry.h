@@ -0,0 +1,90 @@
+#ifndef SHADER_REGISTRY_H
+#define SHADER_REGISTRY_H
+
+#include <Shader.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+
+// pool of the linked shader programs, shared by everything drawn with the same stages and defines
+// a program is compiled the first time it is requested, later requests get the same handle back,
+// so the number of programs grows with the number of distinct shaders and not with the number of objects
+// per-object parameters must not be stored in the program uniforms, since they would leak between the users of the program
+// (the transforms and forward shading materials of the objects live in the ObjectDataBuffer, see GMVPObject::bindObjectData)
+class ShaderRegistry
+{
+public:
+    static ShaderRegistry & get()
+    {
+        static ShaderRegistry registry;
+        return registry;
+    }
+
+    Shader * getShader(const std::string & vertexPath, const std::string & fragmentPath, const std::vector<std::string> & defines = {})
+    {
+        std::string key = makeKey({vertexPath, fragmentPath}, defines);
+        requests++;
+        auto it = programs.find(key);
+        if (it != programs.end()) {
+            return it->second;
+        }
+        Shader * shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines);
+        programs[key] = shader;
+        return shader;
+    }
+
+    Shader * getComputeShader(const std::string & computePath, const std::vector<std::string> & defines = {})
+    {
+        std::string key = makeKey({computePath}, defines);
+        requests++;
+        auto it = programs.find(key);
+        if (it != programs.end()) {
+            return it->second;
+        }
+        Shader * shader = new ComputeShader(computePath.c_str(), defines);
+        programs[key] = shader;
+        return shader;
+    }
+
+    int getProgramCount() const { return programs.size(); }
+
+    void printStats() const
+    {
+        std::cout << "[ShaderRegistry]: " << requests << " shader requests served by " << programs.size() << " programs" << std::endl;
+    }
+
+    // delete every program, the handles given out before become invalid
+    void clear()
+    {
+        for (auto & entry : programs) {
+            glDeleteProgram(entry.second->ID);
+            delete entry.second;
+        }
+        programs.clear();
+    }
+
+private:
+    std::map<std::string, Shader*> programs; // key: stage paths and defines
+    int requests = 0;
+
+    ShaderRegistry() {}
+
+    static std::string makeKey(const std::vector<std::string> & stagePaths, const std::vector<std::string> & defines)
+    {
+        std::string key;
+        for (const std::string & path : stagePaths) {
+            key += path + "|";
+        }
+        for (const std::string & define : defines) {
+            key += "#" + define;
+        }
+        return key;
+    }
+
+    ShaderRegistry(const ShaderRegistry&) = delete;
+    ShaderRegistry& operator=(const ShaderRegistry&) = delete;
+};
+
+#endif
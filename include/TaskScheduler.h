@@ -0,0 +1,284 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <algorithm>
+
+class TaskScheduler;
+
+// a unit of work of the TaskScheduler, it runs once all its dependencies are done
+class Task {
+public:
+    bool isDone() const { return done.load(); }
+
+private:
+    friend class TaskScheduler;
+    std::function<void()> work;
+    bool mainThread = false; // only the main thread may run it (e.g. it creates GL objects)
+    std::atomic<int> pendingDependencies{0};
+    std::atomic<bool> done{false};
+    std::mutex successorMutex; // guards successors and the transition to done
+    std::vector<std::shared_ptr<Task>> successors;
+};
+using TaskHandle = std::shared_ptr<Task>;
+
+// the worker threads shared by the engine (scene loading and other background work)
+// every worker has its own deque: it pushes and pops the tasks it spawns at the back (depth first, cache warm) and, when
+// it runs dry, steals the oldest task at the front of another worker's deque; the tasks become ready when their
+// dependencies are done, so a task graph is just tasks submitted with the handles of the ones they wait for
+// the GL context belongs to the main thread (the thread that first calls get()): the tasks submitted with
+// submitMainThread() only run there, in wait() or in runMainThreadTasks()
+class TaskScheduler
+{
+public:
+    static TaskScheduler & get()
+    {
+        static TaskScheduler scheduler;
+        return scheduler;
+    }
+
+    // run 'work' on a worker once every task of 'dependencies' is done
+    TaskHandle submit(std::function<void()> work, const std::vector<TaskHandle> & dependencies = {})
+    {
+        return addTask(std::move(work), false, dependencies);
+    }
+
+    // run 'work' on the main thread once every task of 'dependencies' is done
+    TaskHandle submitMainThread(std::function<void()> work, const std::vector<TaskHandle> & dependencies = {})
+    {
+        return addTask(std::move(work), true, dependencies);
+    }
+
+    // run tasks until 'task' is done, so waiting never blocks the task it waits for
+    void wait(const TaskHandle & task)
+    {
+        while (!task->isDone()) {
+            if (runOneTask()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait_for(lock, std::chrono::milliseconds(1), [&] { return task->isDone() || hasRunnableTask(); });
+        }
+    }
+
+    void wait(const std::vector<TaskHandle> & tasks)
+    {
+        for (const TaskHandle & task : tasks) {
+            wait(task);
+        }
+    }
+
+    // on the main thread: run the main thread tasks that are ready, e.g. once per frame for the background work
+    void runMainThreadTasks()
+    {
+        while (runOneMainThreadTask()) {
+        }
+    }
+
+    int getWorkerCount() const { return workers.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<TaskHandle> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex mainThreadMutex;
+    std::deque<TaskHandle> mainThreadTasks;
+    std::thread::id mainThreadId;
+    std::atomic<int> queuedTasks{0}; // ready, in the worker deques
+    std::atomic<int> queuedMainThreadTasks{0};
+    std::atomic<unsigned int> nextWorker{0}; // where the main thread puts the next ready task
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp; // a task became ready or done
+
+    TaskScheduler()
+    {
+        mainThreadId = std::this_thread::get_id();
+        int workerCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+        for (int i = 0; i < workerCount; i++) {
+            workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        }
+        for (int i = 0; i < workerCount; i++) {
+            threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+        }
+    }
+
+    ~TaskScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread & thread : threads) {
+            thread.join();
+        }
+    }
+
+    // the index of the worker running on this thread, -1 on the other threads
+    static int & currentWorker()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    bool isMainThread() const { return std::this_thread::get_id() == mainThreadId; }
+
+    bool hasRunnableTask() const
+    {
+        return queuedTasks > 0 || (isMainThread() && queuedMainThreadTasks > 0) || stopping;
+    }
+
+    TaskHandle addTask(std::function<void()> work, bool mainThread, const std::vector<TaskHandle> & dependencies)
+    {
+        TaskHandle task = std::make_shared<Task>();
+        task->work = std::move(work);
+        task->mainThread = mainThread;
+        // one extra count while the dependencies are registered, so the task cannot start before
+        task->pendingDependencies = 1;
+        for (const TaskHandle & dependency : dependencies) {
+            std::lock_guard<std::mutex> lock(dependency->successorMutex);
+            if (!dependency->done) {
+                task->pendingDependencies++;
+                dependency->successors.push_back(task);
+            }
+        }
+        if (--task->pendingDependencies == 0) {
+            schedule(task);
+        }
+        return task;
+    }
+
+    void schedule(const TaskHandle & task)
+    {
+        if (task->mainThread) {
+            std::lock_guard<std::mutex> lock(mainThreadMutex);
+            mainThreadTasks.push_back(task);
+            queuedMainThreadTasks++;
+        }
+        else {
+            int index = currentWorker();
+            if (index < 0) {
+                index = nextWorker++ % workers.size();
+            }
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(task);
+            queuedTasks++;
+        }
+        notify();
+    }
+
+    void notify()
+    {
+        // taking the lock orders the notification after the check of a thread going to sleep
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wakeUp.notify_all();
+    }
+
+    void execute(const TaskHandle & task)
+    {
+        try {
+            task->work();
+        }
+        catch (const std::exception & exception) {
+            std::cout << "[TaskScheduler]: error: a task threw: " << exception.what() << std::endl;
+        }
+        task->work = nullptr;
+        std::vector<TaskHandle> successors;
+        {
+            std::lock_guard<std::mutex> lock(task->successorMutex);
+            task->done = true;
+            successors.swap(task->successors);
+        }
+        for (const TaskHandle & successor : successors) {
+            if (--successor->pendingDependencies == 0) {
+                schedule(successor);
+            }
+        }
+        notify();
+    }
+
+    bool runOneMainThreadTask()
+    {
+        if (!isMainThread() || queuedMainThreadTasks == 0) {
+            return false;
+        }
+        TaskHandle task;
+        {
+            std::lock_guard<std::mutex> lock(mainThreadMutex);
+            if (mainThreadTasks.empty()) {
+                return false;
+            }
+            task = mainThreadTasks.front();
+            mainThreadTasks.pop_front();
+            queuedMainThreadTasks--;
+        }
+        execute(task);
+        return true;
+    }
+
+    // a main thread task on the main thread, else the newest task of the own deque, else the oldest one of another deque
+    bool runOneTask()
+    {
+        if (runOneMainThreadTask()) {
+            return true;
+        }
+        if (queuedTasks == 0) {
+            return false;
+        }
+        int own = currentWorker();
+        TaskHandle task;
+        if (own >= 0) {
+            std::lock_guard<std::mutex> lock(workers[own]->mutex);
+            if (!workers[own]->tasks.empty()) {
+                task = workers[own]->tasks.back();
+                workers[own]->tasks.pop_back();
+            }
+        }
+        for (size_t i = 1; task == nullptr && i <= workers.size(); i++) {
+            Worker & victim = *workers[(std::max(own, 0) + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+            }
+        }
+        if (task == nullptr) {
+            return false;
+        }
+        queuedTasks--;
+        execute(task);
+        return true;
+    }
+
+    void workerLoop(int index)
+    {
+        currentWorker() = index;
+        while (!stopping) {
+            if (runOneTask()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [&] { return queuedTasks > 0 || stopping; });
+        }
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+};
+
+#endif
@@ -319,7 +319,7 @@ public:
 
     void * getData() const { return data; }
 
-    ~Texture() { destroy(); }
+    virtual ~Texture() { destroy(); }
 
 protected:
     void* data = nullptr; // the pixel data in CPU
@@ -0,0 +1,177 @@
+#ifndef TRANSFORM_SYSTEM_H
+#define TRANSFORM_SYSTEM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "RayTraceObject.h"
+#include "TaskScheduler.h"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+// the animated transforms of the scene, data-oriented: the transforms and the parameters of their animations live in
+// contiguous arrays, every animation kind is a system updating all its entries in one loop (split over the workers of
+// the TaskScheduler for large counts), and one sync at the end of the tick pushes the changed transforms to their objects, from where they
+// reach the rasterizer (ObjectDataBuffer), the CPU ray tracer (transform node) and the GPU ray tracer (TLAS refit)
+// the system owns the transforms it animates: a registered object should not be moved by other code in between
+class TransformSystem {
+public:
+    // below this many entries a system runs on the calling thread
+    static const int parallelThreshold = 4096;
+
+    // the transform of a rasterized and ray traced object, registered once, returns its index
+    int addObject(RayTraceObject * object) {
+        auto it = indices.find(object);
+        if (it != indices.end()) {
+            return it->second;
+        }
+        return addTransform(object, object->getModelMatrix(), object, nullptr);
+    }
+
+    // the transform of a point light (a translation to its position)
+    int addLight(PointLight * light) {
+        auto it = indices.find(light);
+        if (it != indices.end()) {
+            return it->second;
+        }
+        return addTransform(light, glm::translate(glm::mat4(1.0f), light->position), nullptr, light);
+    }
+
+    // spin around the local y axis, in degrees per second; replaces an earlier rotation of the transform
+    void addRotation(int transform, float speed) {
+        int entry = findEntry(rotationTransforms, transform);
+        if (entry < 0) {
+            rotationTransforms.push_back(transform);
+            rotationSpeeds.push_back(speed);
+        }
+        else {
+            rotationSpeeds[entry] = speed;
+        }
+    }
+
+    // move back and forth at 'speed' (per second) up to 'range' from the start; replaces an earlier translation of the transform
+    void addPeriodicTranslation(int transform, const glm::vec3 & speed, const glm::vec3 & range) {
+        int entry = findEntry(translationTransforms, transform);
+        if (entry < 0) {
+            translationTransforms.push_back(transform);
+            translationSpeeds.push_back(speed);
+            translationRanges.push_back(range);
+            translationOffsets.push_back(glm::vec3(0.0f));
+        }
+        else {
+            translationSpeeds[entry] = speed;
+            translationRanges[entry] = range;
+            translationOffsets[entry] = glm::vec3(0.0f);
+        }
+    }
+
+    // run the systems, then push the changed transforms to their objects
+    void update(float deltaTime) {
+        updateRotations(deltaTime);
+        updateTranslations(deltaTime);
+        sync();
+    }
+
+    int getTransformCount() const { return models.size(); }
+
+private:
+    // per transform
+    std::vector<glm::mat4> models;
+    std::vector<uint8_t> dirty; // changed since the last sync
+    std::vector<RayTraceObject*> objects; // the owner of the transform, one of the two is set
+    std::vector<PointLight*> lights;
+    std::unordered_map<const SceneObject*, int> indices;
+    // rotation system, at most one entry per transform
+    std::vector<int> rotationTransforms;
+    std::vector<float> rotationSpeeds;
+    // periodic translation system, at most one entry per transform
+    std::vector<int> translationTransforms;
+    std::vector<glm::vec3> translationSpeeds;
+    std::vector<glm::vec3> translationRanges;
+    std::vector<glm::vec3> translationOffsets; // in object space, from the start
+
+    int addTransform(const SceneObject * owner, const glm::mat4 & model, RayTraceObject * object, PointLight * light) {
+        int transform = models.size();
+        models.push_back(model);
+        dirty.push_back(0);
+        objects.push_back(object);
+        lights.push_back(light);
+        indices[owner] = transform;
+        return transform;
+    }
+
+    static int findEntry(const std::vector<int> & transforms, int transform) {
+        auto it = std::find(transforms.begin(), transforms.end(), transform);
+        return (it == transforms.end()) ? -1 : it - transforms.begin();
+    }
+
+    void updateRotations(float deltaTime) {
+        parallelFor(rotationTransforms.size(), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int transform = rotationTransforms[i];
+                models[transform] = glm::rotate(models[transform], glm::radians(rotationSpeeds[i]) * deltaTime, glm::vec3(0, 1, 0));
+                dirty[transform] = 1;
+            }
+        });
+    }
+
+    // the translation is in object space, scaled back so the object moves at the same speed whatever its scale
+    void updateTranslations(float deltaTime) {
+        parallelFor(translationTransforms.size(), [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int transform = translationTransforms[i];
+                glm::mat4 & model = models[transform];
+                glm::vec3 scale = glm::vec3(model[0][0], model[1][1], model[2][2]);
+                glm::vec3 translation = translationSpeeds[i] * deltaTime / scale;
+                if (glm::length(translationOffsets[i] + translation) > glm::length(translationRanges[i] / scale)) {
+                    translation = -translation;
+                    translationSpeeds[i] = -translationSpeeds[i];
+                }
+                model = glm::translate(model, translation);
+                translationOffsets[i] += translation;
+                dirty[transform] = 1;
+            }
+        });
+    }
+
+    // on the calling thread: setModelMatrix also updates the CPU ray tracer and the object records
+    void sync() {
+        for (size_t transform = 0; transform < models.size(); transform++) {
+            if (!dirty[transform]) {
+                continue;
+            }
+            dirty[transform] = 0;
+            if (objects[transform] != nullptr) {
+                objects[transform]->setModelMatrix(models[transform]);
+            }
+            else {
+                lights[transform]->position = glm::vec3(models[transform][3]);
+            }
+        }
+    }
+
+    // run body(begin, end) over [0, count), in contiguous chunks on the scheduler's workers and the calling thread if
+    // count is large
+    template <typename Body>
+    static void parallelFor(int count, const Body & body) {
+        TaskScheduler & scheduler = TaskScheduler::get();
+        int chunkCount = std::min(scheduler.getWorkerCount() + 1, count / (parallelThreshold / 4) + 1);
+        if (count < parallelThreshold || chunkCount <= 1) {
+            body(0, count);
+            return;
+        }
+        std::vector<TaskHandle> chunks;
+        int chunk = (count + chunkCount - 1) / chunkCount;
+        for (int begin = chunk; begin < count; begin += chunk) {
+            int end = std::min(begin + chunk, count);
+            chunks.push_back(scheduler.submit([&body, begin, end] { body(begin, end); }));
+        }
+        body(0, std::min(chunk, count));
+        scheduler.wait(chunks);
+    }
+};
+
+#endif
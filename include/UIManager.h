@@ -6,6 +6,7 @@
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
 #include <FrameRateMonitor.h>
+#include <GPUProfiler.h>
 #include <vector>
 #include <functional>
 #include <string>
@@ -89,10 +90,17 @@ public:
         camera = _camera;
         enableSceneTick = _enableSceneTick;
     }
+    // optional: show the sample statistics of the GPU ray tracer
+    void setRaytraceManager(GPU_RAYTRACER::RaytraceManager * _GPURT_manager) {
+        GPURT_manager = _GPURT_manager;
+    }
+    void setRenderer(Renderer * _renderer) {
+        renderer = _renderer;
+    }
     void drawWindow() override {
         if (!display) return;
         ImGui::SetNextWindowPos(ImVec2(ImGui::GetIO().DisplaySize.x - 240, 10), ImGuiCond_Always);
-		ImGui::SetNextWindowSize(ImVec2(230, 140), ImGuiCond_Always);
+		ImGui::SetNextWindowSize(ImVec2(230, 520), ImGuiCond_Always);
         if (ImGui::Begin("LOG", nullptr, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize)) {
 
 			ImGui::Text("FPS: %.1f ", frameRateMonitor->getFPS()); ImGui::SameLine(); ImGui::Text("| %.1f ", frameRateMonitor->getAverageFPS());
@@ -100,6 +108,59 @@ public:
 			ImGui::Text("CAM POS: %.3f %.3f %.3f", camera->Position[0], camera->Position[1], camera->Position[2]);
 			ImGui::Text("CAM DIR: %.3f %.3f %.3f", camera->Front[0], camera->Front[1], camera->Front[2]);
 			ImGui::Text("CAM FOV: %.3f", camera->Zoom);
+            if (renderer != nullptr) {
+                const RenderQueueStats & stats = renderer->getStats();
+                ImGui::Text("OBJECTS: %d visible | %d culled", stats.visibleObjects, stats.culledObjects);
+                ImGui::Text("DRAWS: %d (%d batched objects)", stats.drawCalls, stats.batchedObjects);
+                ImGui::Text("CHANGES: %d programs | %d textures", stats.programChanges, stats.textureChanges);
+                ImGui::Text("LODS: %d | %d | %d | %d", stats.lodObjects[0], stats.lodObjects[1], stats.lodObjects[2], stats.lodObjects[3]);
+                ImGui::Text("POINT LIGHTS: %d (clustered)", stats.pointLights);
+                bool frustumCulling = renderer->getFrustumCulling();
+                if (ImGui::Checkbox("Frustum Culling", &frustumCulling)) {
+                    renderer->setFrustumCulling(frustumCulling);
+                }
+                bool multiDrawIndirect = renderer->getMultiDrawIndirect();
+                if (ImGui::Checkbox("Multi-Draw Indirect", &multiDrawIndirect)) {
+                    renderer->setMultiDrawIndirect(multiDrawIndirect);
+                }
+                bool occlusionCulling = renderer->getOcclusionCulling();
+                if (ImGui::Checkbox("Occlusion Culling (Hi-Z)", &occlusionCulling)) {
+                    renderer->setOcclusionCulling(occlusionCulling);
+                }
+                bool meshLODs = renderer->getMeshLODs();
+                if (ImGui::Checkbox("Mesh LODs", &meshLODs)) {
+                    renderer->setMeshLODs(meshLODs);
+                }
+            }
+            if (GPURT_manager != nullptr) {
+                ImGui::Text("RT SPP: %d/dispatch | %d", GPURT_manager->getSamplesPerDispatch(), GPURT_manager->getAccumulatedSamples());
+                ImGui::Text("RT GPU: %.2f ms", GPURT_manager->getLastTraceTimeMs());
+                ImGui::Text("RT scale: %.2f (%dx%d)", GPURT_manager->getRenderScale(), GPURT_manager->getTraceWidth(), GPURT_manager->getTraceHeight());
+                bool dynamicResolution = GPURT_manager->getDynamicResolution();
+                if (ImGui::Checkbox("Dynamic Resolution", &dynamicResolution)) {
+                    GPURT_manager->setDynamicResolution(dynamicResolution);
+                }
+                float minScale = GPURT_manager->getMinRenderScale();
+                float maxScale = GPURT_manager->getMaxRenderScale();
+                if (ImGui::DragFloatRange2("Scale", &minScale, &maxScale, 0.01f, 0.25f, 1.0f, "%.2f")) {
+                    GPURT_manager->setRenderScaleBounds(minScale, maxScale);
+                }
+                bool checkerboard = GPURT_manager->getCheckerboard();
+                if (ImGui::Checkbox("Checkerboard", &checkerboard)) {
+                    GPURT_manager->setCheckerboard(checkerboard);
+                }
+                if (ImGui::Button(GPURT_manager->getWavefront() ? "Use Megakernel" : "Use Wavefront")) {
+                    GPURT_manager->setWavefront(!GPURT_manager->getWavefront());
+                }
+                bool reprojection = GPURT_manager->getTemporalReprojection();
+                if (ImGui::Checkbox("Temporal Reprojection", &reprojection)) {
+                    GPURT_manager->setTemporalReprojection(reprojection);
+                }
+                bool denoiser = GPURT_manager->getDenoiser();
+                if (ImGui::Checkbox("Denoiser (SVGF)", &denoiser)) {
+                    GPURT_manager->setDenoiser(denoiser);
+                }
+            }
             if (*enableSceneTick) {
                 if (ImGui::Button("Disable Scene Tick")) {
                     *enableSceneTick = false;
@@ -117,10 +178,51 @@ private:
     FrameRateMonitor * frameRateMonitor;
     Camera * camera;
     bool * enableSceneTick = nullptr;
+    GPU_RAYTRACER::RaytraceManager * GPURT_manager = nullptr;
+    Renderer * renderer = nullptr;
     const char * enableSceneTickText = "Enable Scene Tick";
     const char * disableSceneTickText = "Disable Scene Tick";
 };
 
+// GPU timings of the last profiled frame, with recording and CSV/JSON export
+class ProfilerWindow : public UIWindow {
+public:
+    ProfilerWindow(GPUProfiler * _profiler) {
+        profiler = _profiler;
+    }
+    void drawWindow() override {
+        if (!display) return;
+        ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowSize(ImVec2(260, 240), ImGuiCond_FirstUseEver);
+        if (ImGui::Begin("GPU PROFILER")) {
+            ImGui::Text("FRAME: %d", profiler->getResultFrame());
+            for (const GPUProfiler::ScopeResult & scope : profiler->getResults()) {
+                ImGui::Text("%*s%-22s %6.3f ms", 2 * scope.depth, "", scope.name.c_str(), scope.milliseconds);
+            }
+            if (profiler->isRecording()) {
+                if (ImGui::Button("Stop Recording")) {
+                    profiler->stopRecording();
+                }
+                ImGui::SameLine();
+                ImGui::Text("%d frames", profiler->getRecordedFrameCount());
+            }
+            else if (ImGui::Button("Start Recording")) {
+                profiler->startRecording();
+            }
+            if (ImGui::Button("Dump CSV")) {
+                profiler->dumpCSV("gpu_profile.csv");
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Dump JSON")) {
+                profiler->dumpJSON("gpu_profile.json");
+            }
+        }
+        ImGui::End();
+    }
+private:
+    GPUProfiler * profiler;
+};
+
 
 
 
@@ -0,0 +1,17 @@
+// clustered forward shading (see ClusteredLighting): the point lights of the frame and, for every cluster of the
+// view frustum grid (screen tiles times exponential depth slices), the lights reaching it
+// the grid size must match the constants of ClusteredLighting
+
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 128
+
+struct PointLightData {
+    vec4 positionRange; // xyz: world space position, w: distance beyond which the light is negligible
+    vec4 color;
+};
+layout(std430, binding = 6) readonly buffer PointLightBuffer { PointLightData pointLights[]; };
+layout(std430, binding = 7) buffer ClusterLightCountBuffer { uint clusterLightCounts[]; };
+// MAX_LIGHTS_PER_CLUSTER entries per cluster, indices into pointLights
+layout(std430, binding = 8) buffer ClusterLightIndexBuffer { uint clusterLightIndices[]; };
@@ -0,0 +1,29 @@
+// shared by the stages of the object shader: the per-frame and the per-object data
+
+// per-frame data, written by the renderer before the render queue
+layout(std140, binding = 0) uniform RenderInfo{
+    mat4 view;
+    mat4 projection;
+    vec3 cameraPos;
+    // light properties
+    vec3 lightPos; // the first point light, the object shader reads all of them from the light clusters
+    vec3 lightColor; 
+    vec3 ambientLightColor; // environment light, usually set to sky color
+    int numOfLights; // point lights in the light clusters
+    vec4 clusterParams; // xy: clusters per pixel, z: near plane, w: depth slices per unit of log(depth / near)
+};
+
+// per-object data, the records of all objects in one buffer (see ObjectDataBuffer), a draw selects its own with objectIndex
+struct ObjectData{
+    mat4 model;
+    mat4 normalMatrix; // transpose(inverse(model))
+    vec4 color; // the base color of the object, it also contains the opacity
+    int materialType; //  0: lambertian, 1: metal, 2: dielectric, 3: emissive(light source), -1: unknown
+    float refractionRatio; // aka η aka eta (index of refraction)
+    float averageSlope;  // aka m (roughness)
+    int useTexture;
+};
+layout(std430, binding = 2) readonly buffer ObjectDataBuffer{
+    ObjectData objects[];
+};
+uniform int objectIndex; // -1 for a batched draw, the vertex shader reads the record index from its per-draw attribute
@@ -3,29 +3,16 @@ out vec4 FragColor;
 in vec2 TexCoords;
 in vec3 Normal; // not used currently in this shader
 in vec3 FragPos;
+flat in int ObjectIndex;
 
 uniform sampler2D texture1;
-uniform vec4 color; // the base color of the object, it also contains the opacity
-uniform bool useTexture = false;
-uniform int MaterialType = 0; //  0: lambertian, 1: metal, 2: dielectric, 3: emissive(light source), -1: unknown
 
 uniform samplerCube skyboxTexture; // Cubemap纹理
 
-layout(std140, binding = 0) uniform RenderInfo{
-    mat4 view;
-    mat4 projection;
-    vec3 cameraPos;
-};
-
-uniform float refractionRatio = 0.3; // aka η aka eta (index of refraction)
-uniform float averageSlope = 0.5;  // aka m (roughness)
-
-
-// light properties
-uniform int numOfLights = 1; // not support multiple lights currently, but it won't to too hard to implement
-uniform vec3 lightPos; // a point light
-uniform vec3 lightColor; 
-uniform vec3 ambientLightColor; // environment light, usually set to sky color
+// the per-frame data (camera, light) and the material of the object
+#include "object_common.glsl"
+// the point lights, binned into the clusters of the view frustum
+#include "cluster_common.glsl"
 
 
 const float PI = 3.14159265359;
@@ -36,12 +23,26 @@ uniform float Constant = 1.0;
 uniform float Linear = 0.8;
 uniform float Quadratic = 0.56;
 
+// the cluster of the grid the fragment is in
+uint getCluster() {
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * clusterParams.xy), uvec2(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1));
+    uint slice = uint(clamp(log(depth / clusterParams.z) * clusterParams.w, 0.0, float(CLUSTER_COUNT_Z - 1)));
+    return tile.x + CLUSTER_COUNT_X * (tile.y + CLUSTER_COUNT_Y * slice);
+}
+
 
 void main()
 {
+    vec4 color = objects[ObjectIndex].color;
+    int MaterialType = objects[ObjectIndex].materialType;
+    float refractionRatio = objects[ObjectIndex].refractionRatio;
+    float averageSlope = objects[ObjectIndex].averageSlope;
+    int useTexture = objects[ObjectIndex].useTexture;
+
     vec4 texColor;
 
-    if(useTexture){
+    if(useTexture != 0){
         texColor = texture(texture1, TexCoords);
     }
         
@@ -57,57 +58,73 @@ void main()
     vec3 finalColor, ambientColor, diffuseColor, specularColor;
 
     vec3 normal = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
     vec3 viewDir = normalize(cameraPos - FragPos);
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float NdotH = dot(normal, halfwayDir);
-    float NdotL = dot(normal, lightDir);
     float NdotV = dot(normal, viewDir);
-    float VdotH = dot(viewDir, halfwayDir);
-
-    float Distance = length(lightPos - FragPos);
-    float attenuation = 1.0 / (Constant + Linear * Distance + Quadratic * Distance * Distance);
-
 
     vec4 baseColor = texColor * color;
 
     // ambient
     ambientColor = baseColor.xyz * ambientLightColor;
     ambientColor = max(ambientColor, vec3(0.0,0.0,0.0));
-    // diffuse
-    float diff = max(NdotL, 0.0);
-    diffuseColor =  baseColor.xyz * lightColor * diff;
-    diffuseColor *= attenuation;
-    diffuseColor = max(diffuseColor, vec3(0.0,0.0,0.0));
-    // specular -- Cook-Torrance BRDF
-    float F, D, G;
-    // F: Fresnel term
-    // we use Schlick's approximation
+
     float F0 = pow((1.0 - refractionRatio) / (1.0 + refractionRatio + epsilon), 2.0);
-    F = F0 + (1.0 - F0) * pow(1.0 - dot(lightDir, viewDir), 5.0);
-    // D: roughness term
-    // we use the Beckmann distribution function
     float m = averageSlope;
     float m2 = m * m;
-    float NdotH2 = NdotH * NdotH;
-    float tanAlpha2 = (1.0 - NdotH2) / (NdotH2+epsilon);
-    float numerator = exp(-tanAlpha2 / (m2+epsilon));
-    float denominator = 4.0 * m2 * NdotH2 * NdotH2;
-    D = numerator / (denominator+epsilon);
-    
-    // G: geometry term
-    // we use the Cook-Torrance geometry function
-    float Masking = 2.0 * NdotH * NdotV / (VdotH+epsilon);
-    float Shadowing = 2.0 * NdotH * NdotL / (VdotH+epsilon);
-    G = min(1.0, min(Masking, Shadowing));
-    G = max(G, 0.0);
-
-    // combine
-    float FDG = D * F * G;
-
-    specularColor = ( FDG / (PI * max(NdotV,epsilon)) )* lightColor *  baseColor.xyz;
-    specularColor *= attenuation;
-    specularColor = max(specularColor, vec3(0.0,0.0,0.0));
+    // the Fresnel term of the dielectric mix below, averaged over the lights weighted by their diffuse contribution
+    float fresnelSum = 0.0;
+    float fresnelWeight = 0.0;
+    diffuseColor = vec3(0.0);
+    specularColor = vec3(0.0);
+    // only the lights of the cluster of the fragment
+    uint cluster = getCluster();
+    uint clusterLightCount = clusterLightCounts[cluster];
+    for (uint i = 0; i < clusterLightCount; i++) {
+        PointLightData light = pointLights[clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+        vec3 pointLightPos = light.positionRange.xyz;
+        vec3 pointLightColor = light.color.rgb;
+        float Distance = length(pointLightPos - FragPos);
+        if (Distance > light.positionRange.w) {
+            continue;
+        }
+        vec3 lightDir = normalize(pointLightPos - FragPos);
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        float NdotH = dot(normal, halfwayDir);
+        float NdotL = dot(normal, lightDir);
+        float VdotH = dot(viewDir, halfwayDir);
+        float attenuation = 1.0 / (Constant + Linear * Distance + Quadratic * Distance * Distance);
+
+        // diffuse
+        float diff = max(NdotL, 0.0);
+        diffuseColor += max(baseColor.xyz * pointLightColor * diff * attenuation, vec3(0.0,0.0,0.0));
+        // specular -- Cook-Torrance BRDF
+        float F, D, G;
+        // F: Fresnel term
+        // we use Schlick's approximation
+        F = F0 + (1.0 - F0) * pow(1.0 - dot(lightDir, viewDir), 5.0);
+        // D: roughness term
+        // we use the Beckmann distribution function
+        float NdotH2 = NdotH * NdotH;
+        float tanAlpha2 = (1.0 - NdotH2) / (NdotH2+epsilon);
+        float numerator = exp(-tanAlpha2 / (m2+epsilon));
+        float denominator = 4.0 * m2 * NdotH2 * NdotH2;
+        D = numerator / (denominator+epsilon);
+
+        // G: geometry term
+        // we use the Cook-Torrance geometry function
+        float Masking = 2.0 * NdotH * NdotV / (VdotH+epsilon);
+        float Shadowing = 2.0 * NdotH * NdotL / (VdotH+epsilon);
+        G = min(1.0, min(Masking, Shadowing));
+        G = max(G, 0.0);
+
+        // combine
+        float FDG = D * F * G;
+        specularColor += max(( FDG / (PI * max(NdotV,epsilon)) ) * pointLightColor * baseColor.xyz * attenuation, vec3(0.0,0.0,0.0));
+
+        float weight = diff * attenuation * dot(pointLightColor, vec3(1.0 / 3.0));
+        fresnelSum += F * weight;
+        fresnelWeight += weight;
+    }
+    float F = (fresnelWeight > 0.0) ? fresnelSum / fresnelWeight : F0;
 
     if (MaterialType == 1) // metal
     {
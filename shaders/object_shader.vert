@@ -3,25 +3,25 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+// batched draws (instanced or multi-draw indirect, see IndirectDrawList): the record of the drawn object,
+// one value per instance, the draws start at their own record with their base instance
+layout (location = 3) in int aObjectIndex;
 
-uniform mat4 model;
-
-layout(std140, binding = 0) uniform RenderInfo{
-    mat4 view;
-    mat4 projection;
-    vec3 cameraPos;
-};
+#include "object_common.glsl"
 
 out vec2 TexCoords;
 out vec3 Normal;
 
 out vec3 FragPos;
+flat out int ObjectIndex; // the record of the drawn object or instance
 
 
 void main()
 {
+    ObjectIndex = (objectIndex >= 0) ? objectIndex : aObjectIndex;
+    mat4 model = objects[ObjectIndex].model;
     gl_Position = projection * view * model * vec4(aPos, 1.0f);
     TexCoords = vec2(aTexCoord.x, aTexCoord.y);
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = mat3(objects[ObjectIndex].normalMatrix) * aNormal;
     FragPos = vec3(model * vec4(aPos, 1.0));
 }
\ No newline at end of file
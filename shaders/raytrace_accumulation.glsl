@@ -0,0 +1,29 @@
+// read access to the accumulation image, shared by the passes consuming it (resolve, denoiser)
+
+// rgb: sum of the samples, a: number of samples
+layout(binding = 2, rgba32f) readonly uniform image2D accumulationImage;
+
+// rgb: mean of the samples of pixel p, a: their number
+// a pixel without samples (skipped by the checkerboard tracing since the accumulation restarted) takes the mean of its
+// horizontal and vertical neighbors, which the checkerboard traced; its sample count stays 0
+vec4 loadAccumulatedMean(ivec2 p, ivec2 size) {
+    vec4 accumulated = imageLoad(accumulationImage, p);
+    if (accumulated.a > 0.0) {
+        return vec4(accumulated.rgb / accumulated.a, accumulated.a);
+    }
+    vec3 sum = vec3(0.0);
+    float count = 0.0;
+    const ivec2 offsets[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+    for (int i = 0; i < 4; i++) {
+        ivec2 q = p + offsets[i];
+        if (q.x < 0 || q.y < 0 || q.x >= size.x || q.y >= size.y) {
+            continue;
+        }
+        vec4 neighbor = imageLoad(accumulationImage, q);
+        if (neighbor.a > 0.0) {
+            sum += neighbor.rgb / neighbor.a;
+            count += 1.0;
+        }
+    }
+    return vec4(sum / max(count, 1.0), 0.0);
+}
@@ -0,0 +1,652 @@
+// shared by the megakernel (raytrace_compute_shader.comp) and the wavefront passes (wavefront_*.comp):
+// scene uniforms, random numbers, primitive/BVH fetching, intersection and TLAS traversal
+// included by ComputeShader, which expands #include "file" relative to the including file
+
+uniform vec3 cameraPos;
+uniform vec3 cameraFront; 
+uniform vec3 cameraUp; 
+uniform float fov; // in degrees
+uniform float aspectRatio; 
+uniform int imageWidth;
+uniform int imageHeight;
+uniform bool hasSkybox;
+uniform int primitiveCount;
+uniform int maxDepth;
+
+// scene features, injected as #defines by the manager to compile a variant specialized for the loaded scene
+// without them (e.g. in the wavefront passes) every feature stays enabled and the runtime uniforms are used
+#ifndef MAX_DEPTH
+#define MAX_DEPTH maxDepth
+#endif
+#ifndef HAS_SKYBOX
+#define HAS_SKYBOX hasSkybox
+#endif
+#ifndef HAS_TRIANGLES
+#define HAS_TRIANGLES 1
+#endif
+#ifndef HAS_SPHERES
+#define HAS_SPHERES 1
+#endif
+#ifndef HAS_TEXTURES
+#define HAS_TEXTURES 1
+#endif
+#ifndef MATERIAL_MASK
+#define MATERIAL_MASK 15 // bit i is set if material type i is used
+#endif
+#define MATERIAL_ENABLED(type) ((MATERIAL_MASK & (1 << (type))) != 0)
+
+uniform int frameCounter; // from 1 to inf
+uniform float time;
+
+uniform samplerCube skyboxTexture;
+uniform samplerBuffer primitives; // primitive buffer, the hot part of the triangles and spheres (positions, material index) GL_TEXTURE0 
+uniform samplerBuffer TLAS; // top level acceleration structure buffer, containing BVH nodes for mesh instances, GL_TEXTURE2
+uniform samplerBuffer BLAS; // bottom level acceleration structure buffer, containing BVH nodes for triangles, GL_TEXTURE3
+
+// scene textures, bucketed by size into texture array pages (64, 128, ..., 2048), GL_TEXTURE4 .. GL_TEXTURE9
+// a texture is located by its descriptor (page, layer, size, mip count), GL_TEXTURE10
+#define MAX_TEXTURE_PAGES 6
+uniform sampler2DArray sceneTexturePages[MAX_TEXTURE_PAGES];
+uniform samplerBuffer textureDescriptors;
+uniform float pixelSpreadAngle; // spread angle of the ray cone through one pixel, for the texture LOD
+uniform samplerBuffer materials; // materials referenced by the primitives of merged static objects, GL_TEXTURE11
+uniform usamplerBuffer primitiveIndices; // cold part of the triangles: vertex indices (xyz) and face normal flag (w), GL_TEXTURE12
+uniform usamplerBuffer vertexAttributes; // packed vertex attributes: octahedral normal (snorm16x2), uv (half2), GL_TEXTURE13
+
+// we must define them as MACRO
+// otherwise, the GLSL compiler will not allow us to use them for sampling TBO
+// I don't know why, but it's the truth
+#define PRIMITIVE_LENGTH 3 // 3 * vec4
+#define TLAS_NODE_LENGTH 8 // 8 * vec4
+#define BLAS_NODE_LENGTH 3 // 3 * vec4
+#define MATERIAL_LENGTH 2 // 2 * vec4
+// calculation mathmatical constants
+#define PI 3.14159265359
+#define EPSILON 0.0000001
+
+// Please refer to this repository:
+// https://github.com/AKGWSB/EzRT
+// ----------------------------------------------------------------------------- //
+/*
+ * generate random number, the seed is from the global invocation ID and frame counter
+ * code src：https://blog.demofox.org/2020/05/25/casual-shadertoy-path-tracing-1-basic-camera-diffuse-emissive/
+*/
+uint seed = uint
+            (
+                uint((gl_GlobalInvocationID.x * 0.5 + 0.5) * imageWidth)  * uint(1973) + 
+                uint((gl_GlobalInvocationID.y * 0.5 + 0.5) * imageHeight) * uint(9277) + 
+                uint(frameCounter) * uint(26699)
+            ) 
+            | 
+            uint(1);
+
+uint wang_hash(inout uint seed) {
+    seed = uint(seed ^ uint(61)) ^ uint(seed >> uint(16));
+    seed *= uint(9);
+    seed = seed ^ (seed >> 4);
+    seed *= uint(0x27d4eb2d);
+    seed = seed ^ (seed >> 15);
+    return seed;
+}
+float rand() {
+    return float(wang_hash(seed)) / 4294967296.0;
+}
+// ----------------------------------------------------------------------------- //
+// bad implementation of random vector generation:  'while (true)' rejection sampling is not efficient for GPU
+// vec3 vec3_rand(float _min, float _max) {
+//     return vec3(rand() * (_max - _min) + _min, rand() * (_max - _min) + _min, rand() * (_max - _min) + _min);
+// }
+// vec3 sampleInUnitSphere() {
+//     while (true) {
+//         vec3 p = vec3_rand(-1.0, 1.0);
+//         if (length(p) < 1.0) {
+//             return p;
+//         }
+//     }
+// }
+// vec3 randomUnitSphereVec() {
+//     return normalize(sampleInUnitSphere());
+// }
+// ----------------------------------------------------------------------------- //
+vec3 randomUnitVector() {
+    float z = 2.0 * rand() - 1.0; // rand value from -1 to 1
+    float a = 2.0 * PI * rand(); // rand angle from 0 to 2PI, representing the azimuthal angle φ
+    float r = sqrt(1.0 - z * z); // the radius projection on the xy plane
+    float x = r * cos(a); // the x component
+    float y = r * sin(a); // the y component
+    return vec3(x, y, z); // it's a unit vector in the sphere
+}
+// ----------------------------------------------------------------------------- //
+
+
+
+
+struct Sphere {
+    vec3 center;
+    float radius;
+};
+
+// only the positions are needed during traversal, normals and uvs are fetched for the closest hit
+struct Triangle {
+    vec3 v0;
+    vec3 e1; // v1 - v0
+    vec3 e2; // v2 - v0
+};
+
+Sphere getSphere(int index) {
+    Sphere sphere;
+    sphere.center = texelFetch(primitives, index * PRIMITIVE_LENGTH).xyz;
+    sphere.radius = texelFetch(primitives, index * PRIMITIVE_LENGTH + 1).x;
+    return sphere;
+}
+
+Triangle getTriangle(int index) {
+    Triangle triangle;
+    triangle.v0 = texelFetch(primitives, index * PRIMITIVE_LENGTH).xyz;
+    triangle.e1 = texelFetch(primitives, index * PRIMITIVE_LENGTH + 1).xyz;
+    triangle.e2 = texelFetch(primitives, index * PRIMITIVE_LENGTH + 2).xyz;
+    return triangle;
+}
+
+int getPrimitiveMaterial(int index) {
+    return int(texelFetch(primitives, index * PRIMITIVE_LENGTH).w);
+}
+
+// octahedral normal decoding (Cigolle et al. 2014)
+vec3 decodeOctahedralNormal(uint packedNormal) {
+    vec2 e = unpackSnorm2x16(packedNormal);
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+struct Ray {
+    vec3 origin;
+    vec3 direction;
+};
+
+struct HitRecord {
+    vec3 p;
+    vec3 normal;
+    float t;
+    bool frontFace;
+    vec3 color;
+    int materialType;
+    // fuzziness for metal material, indexOfRefraction for dielectric material
+    float fuzzOrIOR;
+    float u, v;
+    float uvLambda; // 0.5 * log2(uv area / surface area) of the hit primitive, in object space
+    int materialIndex; // material of the hit primitive, -1 to use the material of the TLAS leaf
+    int triangleIndex; // the hit triangle whose attributes are still to be resolved, -1 if resolved or a sphere
+    vec2 barycentric; // barycentric coordinates (b1, b2) of the triangle hit
+};
+
+struct BLASNode{
+    int left;
+    int right;
+    int n; // number of primitives in the node
+    int primitiveIndex; // the index of the first primitive in the node
+    vec3 AA, BB;
+};
+
+struct TLASNode{
+    int left; // -1 if the node is a leaf
+    int right; // -1 if the node is a leaf
+    int BLASIndex; // if the node is a leaf, this is the index of the BLAS node, otherwise, it is -1
+    int materialType; // if the node is a leaf, this is the material type, otherwise, it is -1
+    int textureIndex; // if the node is a leaf and it has texture, this is the index of the texture, otherwise, it is -1
+    vec3 baseColor; // if the node is a leaf, this is the base color, otherwise, it is (0, 0, 0)
+    float fuzzOrIOR; // if the node is a leaf, this is the fuzziness of the metal material or the index of refraction of the dielectric material, otherwise, it is -1
+    vec3 AA, BB; // the axis-aligned bounding box of the node in the world space
+    float sphereRadius; // > 0 if the leaf is an analytic sphere (world space radius, centered in the AABB), otherwise -1
+    mat4 transform; // if the node is a leaf, this is the transformation matrix, otherwise, it is the identity matrix
+};
+
+// I didn't use these quat utilities in this shader, but I will keep them here for future use
+// -----------------------------------------------------------------------------------------------//
+vec4 normalizeQuat(vec4 q) {
+    return q / length(q);
+}
+vec4 quatInverse(vec4 q) {
+    q = normalizeQuat(q);
+    return vec4(q.w, -q.x, -q.y, -q.z);
+}
+vec4 quatMul(vec4 q1, vec4 q2) {
+    return vec4(
+        q1.w*q2.x + q1.x*q2.w + q1.y*q2.z - q1.z*q2.y,
+        q1.w*q2.y - q1.x*q2.z + q1.y*q2.w + q1.z*q2.x,
+        q1.w*q2.z + q1.x*q2.y - q1.y*q2.x + q1.z*q2.w,
+        q1.w*q2.w - q1.x*q2.x - q1.y*q2.y - q1.z*q2.z
+    );
+}
+vec3 rotatePointByQuat(vec3 p, vec4 q) {
+    vec4 pQuat = vec4(0.0, p.x, p.y, p.z);
+    vec4 qInv = quatInverse(q);
+    vec4 pRotatedQuat = quatMul(quatMul(q, pQuat), qInv);
+    return pRotatedQuat.yzw; // 仅返回向量部分
+}
+// -----------------------------------------------------------------------------------------------//
+
+// ray-sphere intersection
+bool hitSphere(Sphere sphere, Ray ray, float tMin, float tMax, inout HitRecord hitRecord) {
+    vec3 oc = ray.origin - sphere.center;
+    float a = dot(ray.direction, ray.direction);
+    float b = 2.0 * dot(oc, ray.direction);
+    float c = dot(oc, oc) - sphere.radius * sphere.radius;
+    float discriminant = b * b - 4.0 * a * c;
+    if (discriminant > 0.0) {
+        float temp = (-b - sqrt(discriminant)) / (2.0 * a);
+        if (temp > tMax || temp < tMin) {
+            temp = (-b + sqrt(discriminant)) / (2.0 * a);
+            }
+        if (temp > tMax || temp < tMin) {
+            return false;
+        }
+        hitRecord.t = temp;
+        hitRecord.p = ray.origin + temp * ray.direction;
+        hitRecord.normal = normalize(hitRecord.p - sphere.center);
+        hitRecord.color = vec3(0.0); // we have let TLAS node to store the color and material type, so primitive does not need to record them
+        hitRecord.materialType = 0; // TLAS will record the material type
+        hitRecord.fuzzOrIOR = 0.0; // TLAS will record the fuzziness or index of refraction
+        hitRecord.frontFace = dot(ray.direction, hitRecord.normal) < 0.0;
+        if (!hitRecord.frontFace) {
+            hitRecord.normal = -hitRecord.normal;
+        }
+        // the u and v are calculated by the hit point's spherical coordinates
+        vec3 hitPointObjectSpace = normalize(hitRecord.p - sphere.center);
+        float theta = acos(hitPointObjectSpace.y);
+        float phi = atan(-hitPointObjectSpace.z, -hitPointObjectSpace.x) + PI;
+        hitRecord.u = phi / (2.0 * PI);
+        hitRecord.v = theta / PI;
+        // the whole uv square is wrapped around the sphere surface
+        hitRecord.uvLambda = 0.5 * log2(1.0 / (4.0 * PI * sphere.radius * sphere.radius));
+        
+        return true;
+    }
+    return false;
+}
+
+// ray-triangle intersection, only finds t and the barycentric coordinates: resolveTriangleHit() completes the closest hit
+// Möller-Trumbore: https://blog.csdn.net/zhanxi1992/article/details/109903792
+bool hitTriangle(Triangle triangle, Ray ray, float tMin, float tMax, inout HitRecord hitRecord) {
+    vec3 E1, E2, S1, S, S2, D;
+    float S1E1, inv_S1E1, b1, b2, t;
+    D = ray.direction;
+    E1 = triangle.e1;
+    E2 = triangle.e2;
+    S1 = cross(D, E2);
+    S1E1 = dot(S1, E1); 
+    if (S1E1 > -EPSILON && S1E1 < EPSILON) {
+        return false;
+    }
+    inv_S1E1 = 1.0 / S1E1;
+    S = ray.origin - triangle.v0;
+    b1 = dot(S, S1) * inv_S1E1;
+    if (b1 < 0.0 || b1 > 1.0) {
+        return false;
+    }
+    S2 = cross(S, E1);
+    b2 = dot(D, S2) * inv_S1E1;
+    if (b2 < 0.0 || b1 + b2 > 1.0) {
+        return false;
+    }
+    t = dot(E2, S2) * inv_S1E1;
+    if (t < tMin || t > tMax) {
+        return false;
+    }
+    //if (dot(ray.direction, cross(E1, E2)) >= 0.0) {
+    //    return false;// enable this line to disable back face (back face culling)
+    //}
+    hitRecord.t = t;
+    hitRecord.barycentric = vec2(b1, b2);
+    return true;
+}
+
+// fetch the cold data of the closest triangle hit: interpolated normal, uv, material (all in object space)
+void resolveTriangleHit(Ray ray, inout HitRecord hitRecord) {
+    int index = hitRecord.triangleIndex;
+    hitRecord.triangleIndex = -1;
+    Triangle triangle = getTriangle(index);
+    uvec4 vertexIndices = texelFetch(primitiveIndices, index);
+    uvec2 a0 = texelFetch(vertexAttributes, int(vertexIndices.x)).xy;
+    uvec2 a1 = texelFetch(vertexAttributes, int(vertexIndices.y)).xy;
+    uvec2 a2 = texelFetch(vertexAttributes, int(vertexIndices.z)).xy;
+    float b1 = hitRecord.barycentric.x;
+    float b2 = hitRecord.barycentric.y;
+    float b0 = 1.0 - b1 - b2;
+
+    vec3 normal;
+    if (vertexIndices.w == 1u) {// if the normal is not provided, we will use face normal
+        normal = normalize(cross(triangle.e1, triangle.e2));
+    } else {
+        normal = normalize(b0 * decodeOctahedralNormal(a0.x) + b1 * decodeOctahedralNormal(a1.x) + b2 * decodeOctahedralNormal(a2.x));
+    }
+    hitRecord.p = ray.origin + hitRecord.t * ray.direction;
+    hitRecord.normal = normal;
+    hitRecord.color = vec3(0.0); // we have let TLAS node to store the color and material type, so primitive does not need to record them
+    hitRecord.materialType = 0; // TLAS will record the material type
+    hitRecord.fuzzOrIOR = 0.0; // TLAS will record the fuzziness or index of refraction
+    hitRecord.materialIndex = getPrimitiveMaterial(index);
+    hitRecord.frontFace = dot(ray.direction, hitRecord.normal) < 0.0;
+    if (!hitRecord.frontFace) {
+        hitRecord.normal = -hitRecord.normal;
+    }
+
+    vec2 t0 = unpackHalf2x16(a0.y);
+    vec2 t1 = unpackHalf2x16(a1.y);
+    vec2 t2 = unpackHalf2x16(a2.y);
+    vec2 uv = b0 * t0 + b1 * t1 + b2 * t2;
+    hitRecord.u = uv.x;
+    hitRecord.v = uv.y;
+    vec2 T1 = t1 - t0;
+    vec2 T2 = t2 - t0;
+    float uvArea = abs(T1.x * T2.y - T2.x * T1.y);
+    hitRecord.uvLambda = 0.5 * log2(max(uvArea, 1e-12) / max(length(cross(triangle.e1, triangle.e2)), 1e-12));
+}
+
+// get intersection point of ray and AABB (in t, if not intersect, return -1)
+bool hitAABB(Ray r, vec3 AA, vec3 BB, float tMin, float tMax) {
+    vec3 invdir = 1.0 / r.direction;
+
+    vec3 f = (BB - r.origin) * invdir;
+    vec3 n = (AA - r.origin) * invdir;
+
+    vec3 tmax = max(f, n);
+    vec3 tmin = min(f, n);
+
+    float t1 = min(tmax.x, min(tmax.y, tmax.z));
+    float t0 = max(tmin.x, max(tmin.y, tmin.z));
+
+    tMin = max(t0, tMin);
+    tMax = min(t1, tMax);
+
+    if (tMax < tMin) {
+        return false;
+    }
+
+    return true;
+
+}
+
+// hit the primitive array, the primitives to check should be sequential in the array from l to r
+// this is ensured by CPU's BVH construction which will sort the primitives
+// a BLAS leaf only holds triangles or only spheres, so there is one loop per type
+bool hitTriangleArray(Ray ray, int l, int r, float tMin, float tMax, inout HitRecord hitRecord){
+    bool hit = false;
+    for (int i = l; i <= r; i++) {
+        Triangle triangle = getTriangle(i);
+        if (hitTriangle(triangle, ray, tMin, tMax, hitRecord)) {
+            tMax = hitRecord.t;
+            hit = true;
+            hitRecord.triangleIndex = i;
+        }
+    }
+    return hit;
+}
+
+bool hitSphereArray(Ray ray, int l, int r, float tMin, float tMax, inout HitRecord hitRecord){
+    bool hit = false;
+    for (int i = l; i <= r; i++) {
+        Sphere sphere = getSphere(i);
+        if (hitSphere(sphere, ray, tMin, tMax, hitRecord)) {
+            tMax = hitRecord.t;
+            hit = true;
+            hitRecord.triangleIndex = -1;
+            hitRecord.materialIndex = getPrimitiveMaterial(i);
+        }
+    }
+    return hit;
+}
+
+// transform the ray from world space to model space
+Ray rayWorldToModel(Ray ray, mat4 modelMatrix) {
+    // first get the inverse of the model matrix
+    mat4 invModelMatrix = inverse(modelMatrix);
+    Ray rayModelSpace;
+    rayModelSpace.origin = (invModelMatrix * vec4(ray.origin, 1.0)).xyz;
+    rayModelSpace.direction = (invModelMatrix * vec4(ray.direction, 0.0)).xyz;
+    return rayModelSpace;
+}
+
+// transform the point from model space to world space
+vec3 pointModelToWorld(vec3 point, mat4 modelMatrix) {
+    vec3 pointWorldSpace = (modelMatrix * vec4(point, 1.0)).xyz;
+    return pointWorldSpace;
+}
+
+// transform the normal from model space to world space
+vec3 normalModelToWorld(vec3 normal, mat4 modelMatrix) {
+    // the normal should be transformed by the inverse transpose of the model matrix
+    // since the model matrix may contain non-uniform scaling
+    mat4 invTranspose = transpose(inverse(modelMatrix));
+    vec3 normalWorldSpace = normalize((invTranspose * vec4(normal, 0.0)).xyz);
+    return normalWorldSpace;
+}
+
+BLASNode getBLASNode(int index) {
+    BLASNode node;
+    vec4 tmp = texelFetch(BLAS, index * BLAS_NODE_LENGTH);
+    node.left = int(tmp.x);
+    node.right = int(tmp.y);
+    node.n = int(tmp.z);
+    node.primitiveIndex = int(tmp.w);
+    node.AA = texelFetch(BLAS, index * BLAS_NODE_LENGTH + 1).xyz;
+    node.BB = texelFetch(BLAS, index * BLAS_NODE_LENGTH + 2).xyz;
+    return node;
+}
+
+TLASNode getTLASNode(int index) {
+    TLASNode node;
+    vec4 tmp = texelFetch(TLAS, index * TLAS_NODE_LENGTH);
+    node.left = int(tmp.x);
+    node.right = int(tmp.y);
+    node.BLASIndex = int(tmp.z);
+    node.materialType = int(tmp.w);
+    tmp = texelFetch(TLAS, index * TLAS_NODE_LENGTH + 1);
+    node.textureIndex = int(tmp.x);
+    node.baseColor = tmp.yzw;
+    tmp = texelFetch(TLAS, index * TLAS_NODE_LENGTH + 2);
+    node.fuzzOrIOR = tmp.x;
+    node.AA = tmp.yzw;
+    tmp = texelFetch(TLAS, index * TLAS_NODE_LENGTH + 3);
+    node.BB = tmp.xyz;
+    node.sphereRadius = tmp.w;
+    node.transform = mat4(
+        texelFetch(TLAS, index * TLAS_NODE_LENGTH + 4).xyzw,
+        texelFetch(TLAS, index * TLAS_NODE_LENGTH + 5).xyzw,
+        texelFetch(TLAS, index * TLAS_NODE_LENGTH + 6).xyzw,
+        texelFetch(TLAS, index * TLAS_NODE_LENGTH + 7).xyzw
+    );
+
+    return node;
+}
+
+// sample a scene texture through its descriptor, lod is relative to a 1x1 texture and gets shifted by the texture size
+// sampler arrays can only be indexed by dynamically uniform expressions, so the page is selected with constant indices
+vec3 sampleSceneTexture(int textureIndex, vec2 uv, float lod) {
+    vec4 descriptor = texelFetch(textureDescriptors, textureIndex);
+    int page = int(descriptor.x);
+    vec3 coord = vec3(uv, descriptor.y);
+    lod = clamp(lod + log2(descriptor.z), 0.0, descriptor.w - 1.0);
+    switch (page) {
+        case 0: return textureLod(sceneTexturePages[0], coord, lod).rgb;
+        case 1: return textureLod(sceneTexturePages[1], coord, lod).rgb;
+        case 2: return textureLod(sceneTexturePages[2], coord, lod).rgb;
+        case 3: return textureLod(sceneTexturePages[3], coord, lod).rgb;
+        case 4: return textureLod(sceneTexturePages[4], coord, lod).rgb;
+        case 5: return textureLod(sceneTexturePages[5], coord, lod).rgb;
+    }
+    return vec3(1.0);
+}
+
+// texture LOD from a ray cone (Akenine-Moller et al. 2019, "Texture Level of Detail Strategies for Real-Time Ray Tracing")
+// coneWidth is the cone width at the ray origin, the cone widens by pixelSpreadAngle per unit distance
+float rayConeLod(Ray ray, HitRecord hitRecord, mat4 transform, float coneWidth) {
+    // object space uv density to world space: areas scale with |det|^(2/3)
+    float lambda = hitRecord.uvLambda - log2(max(abs(determinant(mat3(transform))), 1e-12)) / 3.0;
+    float width = coneWidth + pixelSpreadAngle * hitRecord.t * length(ray.direction);
+    float cosTheta = abs(dot(normalize(ray.direction), hitRecord.normal));
+    return lambda + log2(max(width, 1e-12) / max(cosTheta, 0.1));
+}
+
+// calculate the reflectance based on Schlick's approximation
+float reflectance(float cosine, float refIdx) {
+    float r0 = (1.0 - refIdx) / (1.0 + refIdx);
+    r0 = r0 * r0;
+    return r0 + (1.0 - r0) * pow((1.0 - cosine), 5.0);
+}
+
+bool hitBLAS(Ray ray, float tMin, float tMax, inout HitRecord hitRecord, int BLASIndex) {
+    BLASNode node;
+    bool hit = false;
+    // starting from the root node of the BLAS,
+    int stack[1000];
+    int stackTop = 0;
+    stack[stackTop++] = BLASIndex;// push the root node inside the stack
+    while (stackTop > 0) {
+        int nodeIndex = stack[--stackTop];
+        node = getBLASNode(nodeIndex);
+        if (node.n > 0) { // triangle leaf node
+#if HAS_TRIANGLES
+            if (hitTriangleArray(ray, node.primitiveIndex, node.primitiveIndex + node.n - 1, tMin, tMax, hitRecord)) {
+                tMax = hitRecord.t;
+                hit = true;
+            }
+#endif
+        } 
+        else if (node.n < 0) { // sphere leaf node, -n spheres
+#if HAS_SPHERES
+            if (hitSphereArray(ray, node.primitiveIndex, node.primitiveIndex - node.n - 1, tMin, tMax, hitRecord)) {
+                tMax = hitRecord.t;
+                hit = true;
+            }
+#endif
+        } 
+        else {
+            // we will check the AABB of the node first
+            bool hit_AABB = hitAABB(ray, node.AA, node.BB, tMin, tMax);
+            if (hit_AABB) {
+                // if the AABB is hit, we will push the children nodes into the stack
+                if (node.left != -1) {
+                    stack[stackTop++] = node.left;
+                }
+                if (node.right != -1) {
+                    stack[stackTop++] = node.right;
+                }
+            }
+        }
+    }
+    
+    return hit;
+}
+
+// material of the closest hit inside a TLAS leaf (the node at 'base'): from the material buffer for the primitives of merged static objects,
+// from the leaf itself otherwise; the texture is sampled with the LOD of the ray cone
+void applyLeafMaterial(Ray ray, int base, mat4 transform, float coneWidth, inout HitRecord hitRecord) {
+    int textureIndex;
+    if (hitRecord.materialIndex >= 0) {
+        vec4 materialInfo = texelFetch(materials, hitRecord.materialIndex * MATERIAL_LENGTH);
+        hitRecord.materialType = int(materialInfo.x);
+        hitRecord.fuzzOrIOR = materialInfo.y;
+        textureIndex = int(materialInfo.z);
+        hitRecord.color = texelFetch(materials, hitRecord.materialIndex * MATERIAL_LENGTH + 1).xyz;
+    }
+    else {
+        vec4 header = texelFetch(TLAS, base);
+        vec4 material = texelFetch(TLAS, base + 1);
+        hitRecord.materialType = int(header.w);
+        hitRecord.fuzzOrIOR = texelFetch(TLAS, base + 2).x;
+        textureIndex = int(material.x);
+        hitRecord.color = material.yzw;
+    }
+    // if have texture, we will use the texture color * base color
+#if HAS_TEXTURES
+    if (textureIndex != -1) {
+        vec2 uv = vec2(hitRecord.u, hitRecord.v);
+        float lod = rayConeLod(ray, hitRecord, transform, coneWidth);
+        vec3 textureColor = sampleSceneTexture(textureIndex, uv, lod);
+        hitRecord.color *= textureColor;
+    }
+#endif
+}
+
+// the nodes are read piecewise: the header (children, BLAS index) first, then only what the node kind needs
+// (internal node: its box, analytic sphere leaf: box and radius, instance leaf: its transform)
+bool hitTLAS(Ray ray, float tMin, float tMax, inout HitRecord hitRecord, float coneWidth) {
+    bool hit = false;
+    // starting from the root node of the TLAS,
+    // we will traverse the TLAS in leaf node searching
+    // since the TLAS is a binary tree, we will use a stack to store the nodes (non-recursive since it's GLSL not C++)
+    int stack[100];
+    int stackTop = 0;
+    stack[stackTop++] = 0;// push the root node inside the stack
+    while (stackTop > 0) {
+        int nodeIndex = stack[--stackTop];
+        int base = nodeIndex * TLAS_NODE_LENGTH;
+        vec4 header = texelFetch(TLAS, base); // left, right, BLAS index, material type
+        int BLASIndex = int(header.z);
+        if (BLASIndex == -1) {
+            // we will check the AABB of the node first
+            vec3 AA = texelFetch(TLAS, base + 2).yzw;
+            vec3 BB = texelFetch(TLAS, base + 3).xyz;
+            if (hitAABB(ray, AA, BB, tMin, tMax)) {
+                // if the AABB is hit, we will push the children nodes into the stack
+                if (int(header.x) != -1) {
+                    stack[stackTop++] = int(header.x);
+                }
+                if (int(header.y) != -1) {
+                    stack[stackTop++] = int(header.y);
+                }
+            }
+            continue;
+        }
+        vec4 boxMax = texelFetch(TLAS, base + 3); // xyz: BB, w: radius of an analytic sphere, -1 for an instance
+        if (boxMax.w > 0.0) {
+#if HAS_SPHERES
+            // analytic sphere leaf: intersected in world space, no transform and no BLAS
+            Sphere sphere;
+            sphere.center = 0.5 * (texelFetch(TLAS, base + 2).yzw + boxMax.xyz);
+            sphere.radius = boxMax.w;
+            if (hitSphere(sphere, ray, tMin, tMax, hitRecord)) {
+                tMax = hitRecord.t;
+                hit = true;
+                hitRecord.triangleIndex = -1;
+                hitRecord.materialIndex = -1;
+                applyLeafMaterial(ray, base, mat4(1.0), coneWidth, hitRecord);
+            }
+#endif
+            continue;
+        }
+        // if the node is a leaf, we will check the BLAS node for intersection
+        // keep the hit record if the intersection is closer
+        // so in the end, the hitRecord will contain the closest intersection
+        // the TLAS leaf node contains the model transformation matrix for the BLAS object
+        // we will apply the inverse transformation to the ray to transform the ray into the object space
+        mat4 transform = mat4(
+            texelFetch(TLAS, base + 4),
+            texelFetch(TLAS, base + 5),
+            texelFetch(TLAS, base + 6),
+            texelFetch(TLAS, base + 7)
+        );
+        Ray rayObjectSpace = rayWorldToModel(ray, transform);
+        if (hitBLAS(rayObjectSpace, tMin, tMax, hitRecord, BLASIndex)) {
+            tMax = hitRecord.t;
+            hit = true;
+            // the closest triangle of this instance gets its normal, uv and material now, once
+#if HAS_TRIANGLES
+            if (hitRecord.triangleIndex >= 0) {
+                resolveTriangleHit(rayObjectSpace, hitRecord);
+            }
+#endif
+            // remember to transform the normal and hit point back to the world space
+            hitRecord.p = pointModelToWorld(hitRecord.p, transform);
+            hitRecord.normal = normalModelToWorld(hitRecord.normal, transform);
+            // primitives of merged static objects carry their own material, the others use the material of the node
+            applyLeafMaterial(ray, base, transform, coneWidth, hitRecord);
+        }
+    }
+
+    return hit;
+}
\ No newline at end of file
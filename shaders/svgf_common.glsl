@@ -0,0 +1,36 @@
+// shared by the svgf_*.comp passes (Schied et al. 2017, "Spatiotemporal Variance-Guided Filtering")
+// the filters run on the demodulated lighting (color / albedo), with edge-stopping weights from the G-buffer of the primary hits
+
+uniform int imageWidth;
+uniform int imageHeight;
+uniform float pixelSpreadAngle; // angle covered by one pixel, turns the depth tolerance into pixels
+uniform float sigmaNormal; // exponent of the normal weight
+uniform float sigmaDepth; // tolerated distance to the tangent plane, in pixel footprints
+uniform float sigmaLuminance; // tolerated luminance difference, in standard deviations
+
+// xyz: world space position of the primary hit, w: hit distance (-1 on a miss)
+layout(binding = 4, rgba32f) readonly uniform image2D positionImage;
+// xyz: normal of the primary hit, w: material type
+layout(binding = 5, rgba16f) readonly uniform image2D normalImage;
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+bool insideImage(ivec2 p) {
+    return p.x >= 0 && p.y >= 0 && p.x < imageWidth && p.y < imageHeight;
+}
+
+// how much a neighbor q (pixelDistance away) belongs to the surface of the center pixel p, from their G-buffer texels
+// misses only mix with misses, surfaces need a similar normal and q close to the tangent plane of p
+float geometryWeight(vec4 positionP, vec4 normalP, vec4 positionQ, vec4 normalQ, float pixelDistance) {
+    bool missP = positionP.w < 0.0;
+    bool missQ = positionQ.w < 0.0;
+    if (missP || missQ) {
+        return (missP && missQ) ? 1.0 : 0.0;
+    }
+    float normalWeight = pow(max(dot(normalP.xyz, normalQ.xyz), 0.0), sigmaNormal);
+    float planeDistance = abs(dot(normalP.xyz, positionQ.xyz - positionP.xyz));
+    float tolerance = sigmaDepth * positionP.w * pixelSpreadAngle * pixelDistance + 1e-5;
+    return normalWeight * exp(-planeDistance / tolerance);
+}
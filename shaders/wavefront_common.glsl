@@ -0,0 +1,45 @@
+// wavefront path tracing state, shared by the wavefront_*.comp passes
+// one path per pixel lives in the path state buffer, the passes hand the paths to each other through queues of path indices
+// queues are appended with atomic counters, so every pass only runs over the paths that need it
+
+#define WAVEFRONT_GROUP_SIZE 64
+
+// queue indices, each queue holds up to queueCapacity path indices
+#define QUEUE_EXTEND_0 0 // paths waiting for their next intersection (ping-pong between bounces)
+#define QUEUE_EXTEND_1 1
+#define QUEUE_MATERIAL 2 // QUEUE_MATERIAL + materialType: paths that hit a surface of this material
+#define QUEUE_MISS 6 // paths that left the scene
+#define FETCH_COUNTER 7 // work counter of the persistent extend threads, not a queue
+#define MATERIAL_TYPE_COUNT 4
+
+struct PathState {
+    vec4 origin; // xyz: ray origin, w: ray cone width at the origin
+    vec4 direction; // xyz: ray direction
+    vec4 throughput; // xyz: product of the attenuations along the path
+    vec4 radiance; // xyz: radiance gathered by the path
+    uvec4 info; // x: pixel index, y: random number state
+};
+
+// the closest hit found by the extend pass, consumed by the shade pass of its material
+struct PathHit {
+    vec4 position; // xyz: hit point, w: fuzziness or index of refraction
+    vec4 normal; // xyz: normal against the ray, w: 1 for a front face hit
+    vec4 color; // xyz: surface color, texture applied
+};
+
+layout(std430, binding = 0) buffer PathStateBuffer { PathState paths[]; };
+layout(std430, binding = 1) buffer PathHitBuffer { PathHit hits[]; };
+layout(std430, binding = 2) buffer QueueBuffer { uint queueItems[]; };
+layout(std430, binding = 3) buffer QueueCounterBuffer { uint queueCounts[8]; };
+layout(std430, binding = 4) buffer IndirectArgsBuffer { uint indirectArgs[]; }; // glDispatchComputeIndirect arguments, 3 per queue
+
+uniform int queueCapacity; // number of paths in flight
+
+void pushQueue(int queue, uint pathIndex) {
+    uint slot = atomicAdd(queueCounts[queue], 1u);
+    queueItems[queue * queueCapacity + int(slot)] = pathIndex;
+}
+
+uint getQueueItem(int queue, uint slot) {
+    return queueItems[queue * queueCapacity + int(slot)];
+}
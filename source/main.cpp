@@ -60,6 +60,11 @@ int main() {
     // ------------------------------ create Frame rate monitor object -------------------------
     FrameRateMonitor * frameRateMonitor = new FrameRateMonitor();
     renderer.frameRateMonitor = frameRateMonitor; // attach the frame rate monitor to the renderer for displaying fps
+    // ------------------------------ create GPU profiler object -------------------------------
+    // GPU timings of the render passes, read back a few frames later to avoid stalls
+    GPUProfiler * profiler = new GPUProfiler();
+    renderer.profiler = profiler;
+    GPURT_manager->setProfiler(profiler);
     // -------------- register user input callbacks and loop check functions -------------------
     // create input handler object, which contains the input handling functions
     InputHandler * inputHandler = new InputHandler(renderer.window); 
@@ -97,7 +102,16 @@ int main() {
     // ------------------------------ create log window object ---------------------------------
     bool enable_scene_tick = false; // enable/disable ticking of scene objects
     LogWindow * logWindow = new LogWindow(frameRateMonitor, camera, &enable_scene_tick);
+    logWindow->setRaytraceManager(GPURT_manager);
+    logWindow->setRenderer(&renderer);
     uiManager.RegisterWindow(logWindow); // register the log window to the UI manager
+    ProfilerWindow * profilerWindow = new ProfilerWindow(profiler);
+    uiManager.RegisterWindow(profilerWindow);
+    // all startup shaders are created by now: report whether they came from the program binary cache
+    ShaderCache::get().printStats();
+    ShaderRegistry::get().printStats();
+    GeometryRegistry::get().printStats();
+    MeshPool::get().printStats();
     // -----------------------------------------------------------------------------------------
     // ------------------- get the list of scene objects from the scene ------------------------
     // they will be ticked in the main loop (some will also be rendered in the rendering loop)
@@ -110,6 +124,9 @@ int main() {
         // update the frame rate monitor
         frameRateMonitor->update();
         float deltaTime = frameRateMonitor->getFrameDeltaTime();
+        profiler->beginFrame();
+        // the GL work handed back to the main thread by background tasks
+        TaskScheduler::get().runMainThreadTasks();
         // update the state machine
         std::string last_state = state_machine.get_current_state()->name;
         state_machine.update();
@@ -122,6 +139,8 @@ int main() {
             for (SceneObject * sceneObject : sceneObjects) {
                 sceneObject->Tick(deltaTime);
             }
+            // then the animated transforms, pushed to the raster and ray tracing objects in one sync
+            Scene.transforms.update(deltaTime);
         }
         if ((current_state == "Default render state" || current_state == "GPU_ray_tracing state")&& enable_scene_tick){
             GPURT_manager->updateTLAS();
@@ -218,7 +237,11 @@ int main() {
         else {
             uiManager.disableAllWindows();
         }
-        uiManager.Render();
+        {
+            GPUProfileScope scope(profiler, "ImGui");
+            uiManager.Render();
+        }
+        profiler->endFrame();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         renderer.swap_buffers();